@@ -0,0 +1,140 @@
+//
+//  main.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include <LCMS2C/LCMS2C.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+
+/// Parameters of one transform. No two of them share a cache key.
+struct TransformParameters {
+    long source;
+    long target;
+    long numComponents;
+    long componentSize;
+    LCMSRenderingIntent intent;
+    bool blackPointCompensation;
+};
+
+
+static LCMSColorProfile* fn_nonnull builtInProfile(long index) {
+    switch (index) {
+        case 0: return LCMSColorProfile::createSRGB();
+        case 1: return LCMSColorProfile::createRec709();
+        case 2: return LCMSColorProfile::createRec2020();
+        case 3: return LCMSColorProfile::createDCIP3();
+        default: return LCMSColorProfile::createDCIP3D65();
+    }
+}
+
+
+/// Every pair of different built-in profiles in every half and float pixel format, intent and black point setting.
+///
+/// 8-bit transforms are left out, building lcms's 8-bit tables takes over ten times as long and would dominate the runs.
+static std::vector<TransformParameters> makeParameters() {
+    std::vector<TransformParameters> parameters;
+    for (long source = 0; source < 5; source++) {
+        for (long target = 0; target < 5; target++) {
+            if (source == target) {
+                continue;
+            }
+            for (long numComponents: { 3, 4 }) {
+                for (long componentSize: { 2, 4 }) {
+                    for (long intent = 0; intent < 4; intent++) {
+                        for (bool blackPointCompensation: { false, true }) {
+                            parameters.push_back({ source, target, numComponents, componentSize, static_cast<LCMSRenderingIntent>(intent), blackPointCompensation });
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return parameters;
+}
+
+
+/// Creates every transform of `parameters` once, spread over `numThreads` threads, in a new context with `numShards` shards. Returns transforms per second.
+static double measure(const std::vector<TransformParameters>& parameters, long numThreads, long numShards) {
+    auto context = LCMSContext::create(LCMSAllocator::pooled, numShards);
+    if (context == nullptr) {
+        abort();
+    }
+    
+    std::atomic<long> numReady = 0;
+    std::atomic<bool> go = false;
+    std::atomic<long> numFailed = 0;
+    std::vector<std::thread> threads;
+    for (long t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]() {
+            numReady++;
+            while (go == false) {
+                std::this_thread::yield();
+            }
+            
+            for (size_t i = t; i < parameters.size(); i += numThreads) {
+                auto& p = parameters[i];
+                LCMSConversionOptions options;
+                options.intent = p.intent;
+                options.blackPointCompensation = p.blackPointCompensation;
+                auto transform = LCMSTransform::create(builtInProfile(p.source), builtInProfile(p.target), p.numComponents, p.componentSize, options, 0, context);
+                if (transform == nullptr) {
+                    numFailed++;
+                    continue;
+                }
+                LCMSTransformRelease(transform);
+            }
+        });
+    }
+    
+    while (numReady < numThreads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    LCMSContextRelease(context);
+    if (numFailed > 0) {
+        printf("%ld transforms failed\n", numFailed.load());
+    }
+    return static_cast<double>(parameters.size()) / seconds;
+}
+
+
+/// Creates the same set of transforms on 1 to 32 threads, in a context with a single shared lcms context and in one with a shard per thread.
+///
+/// Pass the number of repetitions as the first argument, the best one is reported. Defaults to one.
+int main(int argc, const char* fn_nonnull argv[]) {
+    auto numRepetitions = argc > 1 ? std::max(1l, atol(argv[1])) : 1l;
+    auto parameters = makeParameters();
+    
+    // Built-in profiles are parsed once, keep that out of the measurements
+    for (long i = 0; i < 5; i++) {
+        builtInProfile(i)->getHandle();
+    }
+    
+    printf("%zu distinct transforms per run, %u cores\n", parameters.size(), std::thread::hardware_concurrency());
+    printf("threads  1 shard (transforms/s)  shard per thread (transforms/s)  speed-up\n");
+    for (long numThreads: { 1, 2, 4, 8, 16, 32 }) {
+        double single = 0;
+        double sharded = 0;
+        for (long i = 0; i < numRepetitions; i++) {
+            single = std::max(single, measure(parameters, numThreads, 1));
+            sharded = std::max(sharded, measure(parameters, numThreads, numThreads));
+        }
+        printf("%7ld  %23.0f  %31.0f  %8.2f\n", numThreads, single, sharded, sharded / single);
+    }
+    
+    return 0;
+}
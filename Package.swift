@@ -51,6 +51,23 @@ let package = Package(
                 .interoperabilityMode(.Cxx)
             ]
         ),
+        // Run with `swift run -c release TransformCreationBenchmark [repetitions]`
+        .executableTarget(
+            name: "TransformCreationBenchmark",
+            dependencies: [
+                .target(name: "LCMS2C")
+            ],
+            path: "Benchmarks/TransformCreationBenchmark"
+        ),
+        .testTarget(
+            name: "LCMS2Tests",
+            dependencies: [
+                .target(name: "LCMS2C")
+            ],
+            swiftSettings: [
+                .interoperabilityMode(.Cxx)
+            ]
+        ),
     ],
     // The lcms2 library was compiled using c17, so set it also here
     cLanguageStandard: .c17,
@@ -6,7 +6,21 @@
 //
 
 #include <LCMS2C/ColorProfile.hpp>
-#include <lcms2.h>
+#include <LCMS2C/LCMSContext.hpp>
+#include "MemoryTracker.hpp"
+#include "ProfileTable.hpp"
+#include "ProfileHeader.hpp"
+#include "LogScope.hpp"
+#include <lcms2_plugin.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 struct tag_reader {
@@ -52,6 +66,85 @@ struct tag_reader {
 };
 
 
+/// lcms IO handler that reads a profile straight from memory owned by the caller.
+///
+/// `cmsOpenProfileFromMem` copies the whole profile before parsing it, the reader only copies the tags lcms reads.
+struct memory_reader {
+    cmsIOHANDLER io;
+    const char* data;
+    cmsUInt32Number size;
+    cmsUInt32Number position;
+    
+    
+    static cmsUInt32Number read(cmsIOHANDLER* io, void* buffer, cmsUInt32Number size, cmsUInt32Number count) {
+        auto reader = reinterpret_cast<memory_reader*>(io);
+        auto length = static_cast<uint64_t>(size) * count;
+        if (reader->position + length > reader->size) {
+            cmsSignalError(io->ContextID, cmsERROR_READ, "Read from memory error. Got %u bytes, block should be of %u bytes", reader->size - reader->position, static_cast<cmsUInt32Number>(length));
+            return 0;
+        }
+        
+        std::memcpy(buffer, reader->data + reader->position, length);
+        reader->position += static_cast<cmsUInt32Number>(length);
+        return count;
+    }
+    
+    
+    static cmsBool seek(cmsIOHANDLER* io, cmsUInt32Number offset) {
+        auto reader = reinterpret_cast<memory_reader*>(io);
+        if (offset > reader->size) {
+            cmsSignalError(io->ContextID, cmsERROR_SEEK, "Too few data; probably corrupted profile");
+            return false;
+        }
+        
+        reader->position = offset;
+        return true;
+    }
+    
+    
+    static cmsUInt32Number tell(cmsIOHANDLER* io) {
+        return reinterpret_cast<memory_reader*>(io)->position;
+    }
+    
+    
+    static cmsBool write(cmsIOHANDLER* io, cmsUInt32Number size, const void* buffer) {
+        return false;
+    }
+    
+    
+    static cmsBool close(cmsIOHANDLER* io) {
+        _cmsFree(io->ContextID, io);
+        return true;
+    }
+    
+    
+    /// Opens a reader of the `data`. It's closed with the profile, the data has to outlive it.
+    static cmsIOHANDLER* fn_nullable open(cmsContext context, const char* fn_nonnull data, long size) {
+        if (size > UINT32_MAX) {
+            return nullptr;
+        }
+        
+        auto reader = static_cast<memory_reader*>(_cmsMallocZero(context, sizeof(memory_reader)));
+        if (reader == nullptr) {
+            return nullptr;
+        }
+        
+        reader->io.stream = reader;
+        reader->io.ContextID = context;
+        reader->io.ReportedSize = static_cast<cmsUInt32Number>(size);
+        reader->io.Read = read;
+        reader->io.Seek = seek;
+        reader->io.Close = close;
+        reader->io.Tell = tell;
+        reader->io.Write = write;
+        reader->data = data;
+        reader->size = static_cast<cmsUInt32Number>(size);
+        reader->position = 0;
+        return &reader->io;
+    }
+};
+
+
 static char* fn_nonnull copyData(const void* fn_nonnull source fn_noescape, long size) {
     auto copy = new char[size];
     std::memcpy(copy, source, size);
@@ -59,137 +152,506 @@ static char* fn_nonnull copyData(const void* fn_nonnull source fn_noescape, long
 }
 
 
-LCMSColorProfile::LCMSColorProfile(const char* fn_nonnull data, long size):
+static LCMSProfileID computeProfileID(cmsContext fn_nullable context, const void* fn_nonnull data, long size) {
+    static_assert(sizeof(LCMSProfileID) == sizeof(cmsProfileID));
+    
+    constexpr long headerSize = 128;
+    constexpr long flagsOffset = 44;
+    constexpr long renderingIntentOffset = 64;
+    constexpr long profileIDOffset = 84;
+    
+    LCMSProfileID profileID = { };
+    auto bytes = static_cast<const cmsUInt8Number*>(data);
+    
+    // Use the profile ID from the ICC header if it's presented
+    if (size >= headerSize) {
+        std::memcpy(&profileID, bytes + profileIDOffset, sizeof(profileID));
+        if (profileID != LCMSProfileID { }) {
+            return profileID;
+        }
+    }
+    
+    auto md5 = cmsMD5alloc(context);
+    if (md5 == nullptr) {
+        printf("Could not compute profile ID\n");
+        return profileID;
+    }
+    
+    if (size >= headerSize) {
+        // Fields the ICC profile ID leaves out
+        cmsUInt8Number header[headerSize];
+        std::memcpy(header, bytes, headerSize);
+        std::memset(header + flagsOffset, 0, 4);
+        std::memset(header + renderingIntentOffset, 0, 4);
+        std::memset(header + profileIDOffset, 0, sizeof(cmsProfileID));
+        
+        cmsMD5add(md5, header, headerSize);
+        cmsMD5add(md5, bytes + headerSize, static_cast<cmsUInt32Number>(size - headerSize));
+    }
+    else {
+        cmsMD5add(md5, bytes, static_cast<cmsUInt32Number>(size));
+    }
+    
+    cmsProfileID digest;
+    cmsMD5finish(&digest, md5);
+    std::memcpy(&profileID, digest.ID8, sizeof(profileID));
+    return profileID;
+}
+
+
+/// Metadata of a colour profile that only lcms can read. Header fields are read in place.
+struct LCMSProfileMetadata {
+    std::string description;
+};
+
+
+static std::string readDescription(cmsHPROFILE profile) {
+    auto size = cmsGetProfileInfoUTF8(profile, cmsInfoDescription, cmsNoLanguage, cmsNoCountry, nullptr, 0);
+    if (size == 0) {
+        return std::string();
+    }
+    
+    std::string description(size, 0);
+    size = cmsGetProfileInfoUTF8(profile, cmsInfoDescription, cmsNoLanguage, cmsNoCountry, description.data(), size);
+    
+    // The size includes the terminating zero
+    description.resize(std::strlen(description.c_str()));
+    return description;
+}
+
+
+LCMSProfileID LCMSProfileID::compute(const void* fn_nonnull data fn_noescape, long size) {
+    return computeProfileID(nullptr, data, size);
+}
+
+
+LCMSColorProfile::LCMSColorProfile(const char* fn_nonnull data, long size, bool borrowingData, LCMSProfileDataRelease fn_nullable releaseData, void* fn_nullable releaseUserData, LCMSContext* fn_nonnull context):
 _referenceCounter(1),
 _data(data),
-_size(size) {
-#if DEBUG
-    // Load lcms color profile
-    cmsHPROFILE profile = cmsOpenProfileFromMem(_data, static_cast<cmsUInt32Number>(_size));
-    if (profile == nullptr) {
-        printf("Could not open ICC profile\n");
-        return;
+_size(size),
+_borrowingData(borrowingData),
+_releaseData(releaseData),
+_releaseUserData(releaseUserData),
+_profileID { },
+_interned(false),
+_immortal(false),
+_parentContext(LCMSContextRetain(context)),
+_memoryTracker(LCMSMemoryTracker::select(context->getMemoryTracker())),
+_profile(nullptr),
+_metadata(nullptr) {
+    if (_borrowingData == false) {
+        _memoryTracker->allocate(LCMSMemoryCategory::profiles, _size);
+    }
+}
+
+
+LCMSColorProfile::~LCMSColorProfile() {
+    if (_interned) {
+        _parentContext->getProfileTable().remove(this);
     }
     
-    wchar_t name[512];
-    auto bytes = cmsGetProfileInfo(profile, cmsInfoDescription, cmsNoLanguage, cmsNoCountry, name, 512);
-    if (bytes) {
-        wcstombs(_name, name, 512);
-        printf("Colour profile description: \"%s\"\n", _name);
+    if (_profile) {
+        cmsCloseProfile(_profile);
+    }
+    _context = nullptr;
+    
+    // lcms is done with the data once the profile is closed
+    if (_borrowingData) {
+        if (_releaseData) {
+            _releaseData(_releaseUserData, _data, _size);
+        }
     }
     else {
-        _name[0] = 0;
-        printf("Could not get colour profile description\n");
+        delete [] _data;
+        _memoryTracker->deallocate(LCMSMemoryCategory::profiles, _size);
     }
+    LCMSContextRelease(_parentContext);
+}
+
+
+void* fn_nullable LCMSColorProfile::getHandle() {
+    std::call_once(_profileOnce, [this]() {
+        // Data lcms would reject never reaches it
+        LCMSProfileHeader header;
+        if (LCMSProfileHeader::read(_data, _size, header) == false) {
+            printf("Invalid ICC profile\n");
+            return;
+        }
+        
+        LCMSMemoryScope memory(_parentContext->getMemoryTracker(), LCMSMemoryCategory::profiles);
+        LCMSLogScope log(_parentContext);
+        
+        // Every profile has its own context, so parsing doesn't contend with other profiles. It has the plugins and the log handler of the parent, but no pointer to it: transforms may keep the context alive after the parent is gone
+        auto context = _parentContext->createProfileHandle();
+        if (context == nullptr) {
+            printf("Could not create lcms context\n");
+            return;
+        }
+        _context = std::shared_ptr<_cmsContext_struct>(context, cmsDeleteContext);
+        
+        // The data outlives the profile, so lcms can read it in place
+        auto io = memory_reader::open(context, _data, _size);
+        _profile = io ? cmsOpenProfileFromIOhandlerTHR(context, io) : nullptr;
+        if (_profile == nullptr) {
+            printf("Could not open ICC profile\n");
+        }
+    });
     
+    return _profile;
+}
+
+
+const LCMSProfileMetadata& LCMSColorProfile::_getMetadata() {
+    std::call_once(_metadataOnce, [this]() {
+        auto metadata = std::make_unique<LCMSProfileMetadata>();
+        cmsHPROFILE profile = getHandle();
+        if (profile) {
+            metadata->description = readDescription(profile);
+        }
+        _metadata = std::move(metadata);
+    });
+    return *_metadata;
+}
+
+
+const char* fn_nonnull LCMSColorProfile::getName() {
+    return _getMetadata().description.c_str();
+}
+
+
+bool LCMSColorProfile::checkIsValid() {
+    LCMSProfileHeader header;
+    return LCMSProfileHeader::read(_data, _size, header);
+}
+
+
+uint32_t LCMSColorProfile::getColorSpaceSignature() {
+    LCMSProfileHeader header;
+    return LCMSProfileHeader::read(_data, _size, header) ? header.colorSpace : 0;
+}
+
+
+uint32_t LCMSColorProfile::getDeviceClassSignature() {
+    LCMSProfileHeader header;
+    return LCMSProfileHeader::read(_data, _size, header) ? header.deviceClass : 0;
+}
+
+
+uint32_t LCMSColorProfile::getPCSSignature() {
+    LCMSProfileHeader header;
+    return LCMSProfileHeader::read(_data, _size, header) ? header.pcs : 0;
+}
+
+
+double LCMSColorProfile::getVersion() {
+    LCMSProfileHeader header;
+    return LCMSProfileHeader::read(_data, _size, header) ? header.getVersion() : 0;
+}
+
+
+LCMSRenderingIntent LCMSColorProfile::getRenderingIntent() {
+    // ICC keeps the intent in the lower 16 bits
+    LCMSProfileHeader header;
+    if (LCMSProfileHeader::read(_data, _size, header) == false || (header.renderingIntent & 0xFFFF) > static_cast<uint32_t>(LCMSRenderingIntent::absoluteColorimetric)) {
+        return LCMSRenderingIntent::perceptual;
+    }
+    return static_cast<LCMSRenderingIntent>(header.renderingIntent & 0xFFFF);
+}
+
+
+bool LCMSColorProfile::hasTag(uint32_t signature) {
+    LCMSProfileHeader header;
+    return LCMSProfileHeader::read(_data, _size, header) && header.findTag(signature);
+}
+
+
+LCMSProfileID LCMSColorProfile::getProfileID() {
+    std::call_once(_profileIDOnce, [this]() {
+        _profileID = computeProfileID(_parentContext->getHandle(), _data, _size);
+    });
+    return _profileID;
+}
+
+
+LCMSColorProfile* fn_nonnull LCMSColorProfile::create(const void* fn_nonnull data fn_noescape, long size, LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
+    return new LCMSColorProfile(copyData(data, size), size, false, nullptr, nullptr, lcmsContextOrDefault(context));
+}
+
+
+LCMSColorProfile* fn_nonnull LCMSColorProfile::createBorrowing(const void* fn_nonnull data, long size, LCMSProfileDataRelease fn_nullable releaseData, void* fn_nullable userData, LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
+    return new LCMSColorProfile(static_cast<const char*>(data), size, true, releaseData, userData, lcmsContextOrDefault(context));
+}
+
+
+LCMSColorProfile* fn_nonnull LCMSColorProfile::createStatic(const void* fn_nonnull data, long size, LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
+    return createBorrowing(data, size, nullptr, nullptr, context);
+}
+
+
+static void unmapData(const void* fn_nonnull data, long size) {
+    munmap(const_cast<void*>(data), size);
+}
+
+
+LCMSColorProfile* fn_nullable LCMSColorProfile::createFromFile(const char* fn_nonnull path, LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
+    // Opening a FIFO or a device doesn't wait for a writer or the hardware
+    auto file = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (file < 0) {
+        printf("Could not open \"%s\"\n", path);
+        return nullptr;
+    }
     
-//    auto names = tag_reader::readTag<cmsNAMEDCOLORLIST>(profile, cmsSigNamedColor2Tag);
-//    if (names == nullptr) {
-//        printf("Colour profile has no name tag\n");
-//        return;
-//    }
-//    
-//    auto numNames = cmsNamedColorCount(names);
-//    for (auto i = 0; i < numNames; i++) {
-//        char name[256];
-//        char prefix[33];
-//        char suffix[33];
-//        auto success = cmsNamedColorInfo(names, i, name, prefix, suffix, nullptr, nullptr);
-//        if (success) {
-//            printf("Name #%d:\"%s\", prefix: \"%s\", suffix: \"%s\"\n", i, name, prefix, suffix);
-//        }
-//        else {
-//            printf("Could not read name #%d\n", i);
-//        }
-//    }
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        printf("Could not get the size of \"%s\"\n", path);
+        close(file);
+        return nullptr;
+    }
     
-    cmsCloseProfile(profile);
-#endif
+    // Only regular files can be mapped and have a meaningful size
+    if (S_ISREG(info.st_mode) == false) {
+        printf("\"%s\" is not a regular file\n", path);
+        close(file);
+        return nullptr;
+    }
+    
+    if (info.st_size < LCMSProfileHeader::minSize || info.st_size > UINT32_MAX) {
+        printf("\"%s\" is not an ICC profile\n", path);
+        close(file);
+        return nullptr;
+    }
+    
+    // The mapping stays valid after the file is closed
+    auto size = static_cast<long>(info.st_size);
+    auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        printf("Could not map \"%s\"\n", path);
+        return nullptr;
+    }
+    
+    LCMSProfileHeader header;
+    if (LCMSProfileHeader::read(data, size, header) == false) {
+        printf("\"%s\" is not an ICC profile\n", path);
+        unmapData(data, size);
+        return nullptr;
+    }
+    
+    auto releaseData = [](void* fn_nullable, const void* fn_nonnull data, long size) {
+        unmapData(data, size);
+    };
+    return createBorrowing(data, size, releaseData, nullptr, context);
 }
 
 
-LCMSColorProfile::~LCMSColorProfile() {
-    delete [] _data;
+static bool hasProfileExtension(const char* fn_nonnull name) {
+    auto extension = std::strrchr(name, '.');
+    if (extension == nullptr) {
+        return false;
+    }
+    
+    return strcasecmp(extension, ".icc") == 0 || strcasecmp(extension, ".icm") == 0;
 }
 
 
-LCMSColorProfile* fn_nonnull LCMSColorProfile::create(const void* fn_nonnull data fn_noescape, long size) SWIFT_RETURNS_RETAINED {
-    return new LCMSColorProfile(copyData(data, size), size);
+long LCMSColorProfile::loadDirectory(const char* fn_nonnull path, LCMSProfileDirectoryHandler fn_nonnull handler, void* fn_nullable userData, LCMSContext* fn_nullable context) {
+    auto directory = opendir(path);
+    if (directory == nullptr) {
+        printf("Could not open directory \"%s\"\n", path);
+        return -1;
+    }
+    
+    long numProfiles = 0;
+    std::string filePath;
+    while (auto entry = readdir(directory)) {
+        if (hasProfileExtension(entry->d_name) == false) {
+            continue;
+        }
+        
+        filePath = path;
+        if (filePath.empty() == false && filePath.back() != '/') {
+            filePath += '/';
+        }
+        filePath += entry->d_name;
+        
+        // Subdirectories and files that aren't profiles are skipped
+        auto profile = createFromFile(filePath.c_str(), context);
+        if (profile == nullptr) {
+            continue;
+        }
+        
+        handler(userData, filePath.c_str(), profile);
+        LCMSColorProfileRelease(profile);
+        numProfiles++;
+    }
+    
+    closedir(directory);
+    return numProfiles;
+}
+
+
+static bool isDefaultContext(LCMSContext* fn_nullable context) {
+    return context == nullptr || context == LCMSContext::getDefault();
 }
 
 
-LCMSColorProfile* fn_nonnull LCMSColorProfile::createSRGB() SWIFT_RETURNS_RETAINED {
-    auto profile = cmsCreate_sRGBProfile();
+/// Returns the built-in profile of the default context with the same bytes as `data`, or `nullptr` if there's none.
+static LCMSColorProfile* fn_nullable findBuiltIn(const void* fn_nonnull data, long size) {
+    static LCMSColorProfile* const builtIns[] = {
+        LCMSColorProfile::createSRGB(),
+        LCMSColorProfile::createRec709(),
+        LCMSColorProfile::createRec2020(),
+        LCMSColorProfile::createDCIP3(),
+        LCMSColorProfile::createDCIP3D65()
+    };
     
-    // Prepare for serialisation into memory
-    cmsUInt32Number profileSize = 0;
-    auto canSave = cmsSaveProfileToMem(profile, nullptr, &profileSize);
-    if (canSave == false) {
-        printf("Could not prepare ICC profile for serialisation\n");
-        cmsCloseProfile(profile);
-        return createRec709();
+    for (auto profile: builtIns) {
+        if (profile->getSize() == size && memcmp(profile->getData(), data, size) == 0) {
+            return profile;
+        }
     }
     
-    // Serialise into memory
-    auto profileData = new char[profileSize];
-    auto saved = cmsSaveProfileToMem(profile, profileData, &profileSize);
-    if (saved == false) {
-        printf("Could not serialize ICC profile\n");
-        delete [] profileData;
-        cmsCloseProfile(profile);
-        return createRec709();
+    return nullptr;
+}
+
+
+LCMSColorProfile* fn_nonnull LCMSColorProfile::createInterned(const void* fn_nonnull data fn_noescape, long size, LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
+    // Built-in profiles of the default context exist only once, they're never interned next to them
+    if (isDefaultContext(context)) {
+        if (auto profile = findBuiltIn(data, size)) {
+            return profile;
+        }
     }
     
-    // Create profile
-    auto sRGBProfile = LCMSColorProfile::create(profileData, profileSize);
+    context = lcmsContextOrDefault(context);
+    auto profileID = LCMSProfileID::compute(data, size);
+    return context->getProfileTable().intern(profileID, data, size, [&]() {
+        return create(data, size, context);
+    });
+}
+
+
+/// Interns a built-in profile in a context other than the default one without copying its static `data`.
+static LCMSColorProfile* fn_nonnull internStatic(const void* fn_nonnull data, long size, LCMSContext* fn_nonnull context) {
+    auto profileID = LCMSProfileID::compute(data, size);
+    return context->getProfileTable().intern(profileID, data, size, [&]() {
+        return LCMSColorProfile::createStatic(data, size, context);
+    });
+}
+
+
+LCMSColorProfile* fn_nonnull LCMSColorProfile::_makeImmortal(LCMSColorProfile* fn_nonnull profile) {
+    profile->_immortal = true;
+    profile->getHandle();
+    profile->getProfileID();
+    return profile;
+}
+
+
+/// lcms sRGB profile serialised into memory, built once. Empty if lcms could not serialise it.
+///
+/// Intentionally leaked, the built-in profiles borrow it.
+static const std::vector<char>& sRGBData() {
+    static auto& data = *new std::vector<char>([]() {
+        std::vector<char> data;
+        
+        auto context = LCMSContext::getDefault();
+        LCMSMemoryScope memory(context->getMemoryTracker(), LCMSMemoryCategory::profiles);
+        auto profile = cmsCreate_sRGBProfileTHR(context->getHandle());
+        if (profile == nullptr) {
+            printf("Could not create sRGB profile\n");
+            return data;
+        }
+        
+        // Prepare for serialisation into memory
+        cmsUInt32Number profileSize = 0;
+        auto canSave = cmsSaveProfileToMem(profile, nullptr, &profileSize);
+        if (canSave == false) {
+            printf("Could not prepare ICC profile for serialisation\n");
+            cmsCloseProfile(profile);
+            return data;
+        }
+        
+        // Serialise into memory
+        data.resize(profileSize);
+        auto saved = cmsSaveProfileToMem(profile, data.data(), &profileSize);
+        if (saved == false) {
+            printf("Could not serialize ICC profile\n");
+            data.clear();
+        }
+        
+        cmsCloseProfile(profile);
+        return data;
+    }());
+    return data;
+}
+
+
+LCMSColorProfile* fn_nonnull LCMSColorProfile::createSRGB(LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
+    auto& data = sRGBData();
+    if (data.empty()) {
+        return createRec709(context);
+    }
     
-    // Clean up
-    delete [] profileData;
-    cmsCloseProfile(profile);
+    if (isDefaultContext(context)) {
+        static auto profile = _makeImmortal(createStatic(data.data(), data.size()));
+        return profile;
+    }
     
-    return sRGBProfile;
+    return internStatic(data.data(), data.size(), context);
 }
 
 
-LCMSColorProfile* fn_nonnull LCMSColorProfile::createRec709() SWIFT_RETURNS_RETAINED {
+LCMSColorProfile* fn_nonnull LCMSColorProfile::createRec709(LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
     static const unsigned char rec709Data[] = { 0x00, 0x00, 0x02, 0x54, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x6D, 0x6E, 0x74, 0x72, 0x52, 0x47, 0x42, 0x20, 0x58, 0x59, 0x5A, 0x20, 0x07, 0xDB, 0x00, 0x02, 0x00, 0x10, 0x00, 0x12, 0x00, 0x1D, 0x00, 0x21, 0x61, 0x63, 0x73, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF6, 0xD6, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x00, 0x00, 0x00, 0x00, 0x6F, 0x72, 0x3A, 0x61, 0x57, 0x09, 0xAE, 0xA0, 0xE1, 0x65, 0x88, 0x4C, 0x20, 0x1D, 0x80, 0xE4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0B, 0x64, 0x65, 0x73, 0x63, 0x00, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x79, 0x62, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x01, 0x84, 0x00, 0x00, 0x00, 0x14, 0x62, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0x98, 0x00, 0x00, 0x00, 0x10, 0x67, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x01, 0xA8, 0x00, 0x00, 0x00, 0x14, 0x67, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0x98, 0x00, 0x00, 0x00, 0x10, 0x72, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x01, 0xBC, 0x00, 0x00, 0x00, 0x14, 0x72, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0x98, 0x00, 0x00, 0x00, 0x10, 0x74, 0x65, 0x63, 0x68, 0x00, 0x00, 0x01, 0xD0, 0x00, 0x00, 0x00, 0x0C, 0x77, 0x74, 0x70, 0x74, 0x00, 0x00, 0x01, 0xDC, 0x00, 0x00, 0x00, 0x14, 0x63, 0x70, 0x72, 0x74, 0x00, 0x00, 0x01, 0xF0, 0x00, 0x00, 0x00, 0x37, 0x63, 0x68, 0x61, 0x64, 0x00, 0x00, 0x02, 0x28, 0x00, 0x00, 0x00, 0x2C, 0x64, 0x65, 0x73, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x49, 0x54, 0x55, 0x2D, 0x52, 0x20, 0x42, 0x54, 0x2E, 0x37, 0x30, 0x39, 0x20, 0x52, 0x65, 0x66, 0x65, 0x72, 0x65, 0x6E, 0x63, 0x65, 0x20, 0x44, 0x69, 0x73, 0x70, 0x6C, 0x61, 0x79, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x24, 0xA0, 0x00, 0x00, 0x0F, 0x84, 0x00, 0x00, 0xB6, 0xCF, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x66, 0x00, 0x00, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x62, 0x99, 0x00, 0x00, 0xB7, 0x85, 0x00, 0x00, 0x18, 0xDA, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x6F, 0xA2, 0x00, 0x00, 0x38, 0xF5, 0x00, 0x00, 0x03, 0x90, 0x73, 0x69, 0x67, 0x20, 0x00, 0x00, 0x00, 0x00, 0x43, 0x52, 0x54, 0x20, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF6, 0xD6, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x74, 0x65, 0x78, 0x74, 0x00, 0x00, 0x00, 0x00, 0x43, 0x6F, 0x70, 0x79, 0x72, 0x69, 0x67, 0x68, 0x74, 0x20, 0x49, 0x6E, 0x74, 0x65, 0x72, 0x6E, 0x61, 0x74, 0x69, 0x6F, 0x6E, 0x61, 0x6C, 0x20, 0x43, 0x6F, 0x6C, 0x6F, 0x72, 0x20, 0x43, 0x6F, 0x6E, 0x73, 0x6F, 0x72, 0x74, 0x69, 0x75, 0x6D, 0x2C, 0x20, 0x32, 0x30, 0x31, 0x31, 0x00, 0x00, 0x73, 0x66, 0x33, 0x32, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0C, 0x44, 0x00, 0x00, 0x05, 0xDF, 0xFF, 0xFF, 0xF3, 0x26, 0x00, 0x00, 0x07, 0x94, 0x00, 0x00, 0xFD, 0x8F, 0xFF, 0xFF, 0xFB, 0xA1, 0xFF, 0xFF, 0xFD, 0xA2, 0x00, 0x00, 0x03, 0xDB, 0x00, 0x00, 0xC0, 0x75 };
     
-    return create(rec709Data, sizeof(rec709Data));
+    if (isDefaultContext(context)) {
+        static auto profile = _makeImmortal(createStatic(rec709Data, sizeof(rec709Data)));
+        return profile;
+    }
+    
+    return internStatic(rec709Data, sizeof(rec709Data), context);
 }
 
 
-LCMSColorProfile* fn_nonnull LCMSColorProfile::createRec2020() SWIFT_RETURNS_RETAINED {
+LCMSColorProfile* fn_nonnull LCMSColorProfile::createRec2020(LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
     static const unsigned char rec2020Data[] = {
         0x00, 0x00, 0x02, 0xDC, 0x41, 0x44, 0x42, 0x45, 0x04, 0x30, 0x00, 0x00, 0x6D, 0x6E, 0x74, 0x72, 0x52, 0x47, 0x42, 0x20, 0x58, 0x59, 0x5A, 0x20, 0x07, 0xE0, 0x00, 0x09, 0x00, 0x1D, 0x00, 0x12, 0x00, 0x0A, 0x00, 0x00, 0x61, 0x63, 0x73, 0x70, 0x4D, 0x53, 0x46, 0x54, 0x00, 0x00, 0x00, 0x00, 0x49, 0x54, 0x55, 0x20, 0x32, 0x30, 0x32, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0xF6, 0xD6, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x49, 0x43, 0x43, 0x20, 0xD2, 0xDD, 0x42, 0x64, 0x10, 0x7C, 0x8B, 0xB8, 0x84, 0xB9, 0xD7, 0xE6, 0xD4, 0x38, 0x4B, 0xA2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0D, 0x64, 0x65, 0x73, 0x63, 0x00, 0x00, 0x01, 0x20, 0x00, 0x00, 0x00, 0x5A, 0x63, 0x70, 0x72, 0x74, 0x00, 0x00, 0x01, 0x7C, 0x00, 0x00, 0x00, 0x7E, 0x77, 0x74, 0x70, 0x74, 0x00, 0x00, 0x01, 0xFC, 0x00, 0x00, 0x00, 0x14, 0x62, 0x6B, 0x70, 0x74, 0x00, 0x00, 0x02, 0x10, 0x00, 0x00, 0x00, 0x14, 0x72, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x24, 0x00, 0x00, 0x00, 0x14, 0x67, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x38, 0x00, 0x00, 0x00, 0x14, 0x62, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x4C, 0x00, 0x00, 0x00, 0x14, 0x6C, 0x75, 0x6D, 0x69, 0x00, 0x00, 0x02, 0x60, 0x00, 0x00, 0x00, 0x14, 0x74, 0x65, 0x63, 0x68, 0x00, 0x00, 0x02, 0x74, 0x00, 0x00, 0x00, 0x0C, 0x63, 0x68, 0x61, 0x64, 0x00, 0x00, 0x02, 0x80, 0x00, 0x00, 0x00, 0x2C, 0x72, 0x54, 0x52, 0x43, 0x00, 0x00, 0x02, 0xAC, 0x00, 0x00, 0x00, 0x10, 0x67, 0x54, 0x52, 0x43, 0x00, 0x00, 0x02, 0xBC, 0x00, 0x00, 0x00, 0x10, 0x62, 0x54, 0x52, 0x43, 0x00, 0x00, 0x02, 0xCC, 0x00, 0x00, 0x00, 0x10, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x53, 0x00, 0x00, 0x00, 0x3E, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x49, 0x00, 0x54, 0x00, 0x55, 0x00, 0x2D, 0x00, 0x52, 0x00, 0x20, 0x00, 0x42, 0x00, 0x54, 0x00, 0x2E, 0x00, 0x32, 0x00, 0x30, 0x00, 0x32, 0x00, 0x30, 0x00, 0x20, 0x00, 0x52, 0x00, 0x65, 0x00, 0x66, 0x00, 0x65, 0x00, 0x72, 0x00, 0x65, 0x00, 0x6E, 0x00, 0x63, 0x00, 0x65, 0x00, 0x20, 0x00, 0x44, 0x00, 0x69, 0x00, 0x73, 0x00, 0x70, 0x00, 0x6C, 0x00, 0x61, 0x00, 0x79, 0x00, 0x00, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x53, 0x00, 0x00, 0x00, 0x62, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x70, 0x00, 0x79, 0x00, 0x72, 0x00, 0x69, 0x00, 0x67, 0x00, 0x68, 0x00, 0x74, 0x00, 0x20, 0x00, 0x28, 0x00, 0x63, 0x00, 0x29, 0x00, 0x20, 0x00, 0x32, 0x00, 0x30, 0x00, 0x31, 0x00, 0x36, 0x00, 0x20, 0x00, 0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x72, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x74, 0x00, 0x69, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x6C, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6C, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x73, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x74, 0x00, 0x69, 0x00, 0x75, 0x00, 0x6D, 0x00, 0x00, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF6, 0xD6, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xAC, 0x67, 0x00, 0x00, 0x47, 0x6E, 0xFF, 0xFF, 0xFF, 0x81, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2A, 0x68, 0x00, 0x00, 0xAC, 0xE4, 0x00, 0x00, 0x07, 0xAD, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x03, 0x00, 0x00, 0x0B, 0xAD, 0x00, 0x00, 0xCC, 0x01, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x73, 0x69, 0x67, 0x20, 0x00, 0x00, 0x00, 0x00, 0x76, 0x69, 0x64, 0x6D, 0x73, 0x66, 0x33, 0x32, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0C, 0x42, 0x00, 0x00, 0x05, 0xDE, 0xFF, 0xFF, 0xF3, 0x25, 0x00, 0x00, 0x07, 0x93, 0x00, 0x00, 0xFD, 0x90, 0xFF, 0xFF, 0xFB, 0xA1, 0xFF, 0xFF, 0xFD, 0xA2, 0x00, 0x00, 0x03, 0xDC, 0x00, 0x00, 0xC0, 0x6E, 0x70, 0x61, 0x72, 0x61, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x66, 0x66, 0x70, 0x61, 0x72, 0x61, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x66, 0x66, 0x70, 0x61, 0x72, 0x61, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x66, 0x66 };
     
-    return create(rec2020Data, sizeof(rec2020Data));
+    if (isDefaultContext(context)) {
+        static auto profile = _makeImmortal(createStatic(rec2020Data, sizeof(rec2020Data)));
+        return profile;
+    }
+    
+    return internStatic(rec2020Data, sizeof(rec2020Data), context);
 }
 
 
-LCMSColorProfile* fn_nonnull LCMSColorProfile::createDCIP3() SWIFT_RETURNS_RETAINED {
+LCMSColorProfile* fn_nonnull LCMSColorProfile::createDCIP3(LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
     static const unsigned char dciP3Data[] = { 0x00, 0x00, 0x02, 0x5C, 0x00, 0x00, 0x00, 0x00, 0x04, 0x30, 0x00, 0x00, 0x6D, 0x6E, 0x74, 0x72, 0x52, 0x47, 0x42, 0x20, 0x58, 0x59, 0x5A, 0x20, 0x07, 0xE1, 0x00, 0x06, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x61, 0x63, 0x73, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0xF6, 0xD6, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x43, 0x49, 0x47, 0x4C, 0xC5, 0x09, 0xF0, 0x89, 0xDF, 0x32, 0x77, 0xB1, 0xB1, 0x61, 0x31, 0x7B, 0x35, 0x9C, 0x7C, 0xD9, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0B, 0x63, 0x70, 0x72, 0x74, 0x00, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x64, 0x64, 0x65, 0x73, 0x63, 0x00, 0x00, 0x01, 0x6C, 0x00, 0x00, 0x00, 0x30, 0x77, 0x74, 0x70, 0x74, 0x00, 0x00, 0x01, 0x9C, 0x00, 0x00, 0x00, 0x14, 0x63, 0x68, 0x61, 0x64, 0x00, 0x00, 0x01, 0xB0, 0x00, 0x00, 0x00, 0x2C, 0x72, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xDC, 0x00, 0x00, 0x00, 0x10, 0x67, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xEC, 0x00, 0x00, 0x00, 0x10, 0x62, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xFC, 0x00, 0x00, 0x00, 0x10, 0x72, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x0C, 0x00, 0x00, 0x00, 0x14, 0x67, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x20, 0x00, 0x00, 0x00, 0x14, 0x62, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x34, 0x00, 0x00, 0x00, 0x14, 0x6C, 0x75, 0x6D, 0x69, 0x00, 0x00, 0x02, 0x48, 0x00, 0x00, 0x00, 0x14, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x4B, 0x00, 0x00, 0x00, 0x48, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x72, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x74, 0x00, 0x69, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x6C, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6C, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x73, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x74, 0x00, 0x69, 0x00, 0x75, 0x00, 0x6D, 0x00, 0x2C, 0x00, 0x20, 0x00, 0x32, 0x00, 0x30, 0x00, 0x31, 0x00, 0x37, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x4B, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x44, 0x00, 0x43, 0x00, 0x49, 0x00, 0x20, 0x00, 0x50, 0x00, 0x33, 0x00, 0x20, 0x00, 0x44, 0x00, 0x43, 0x00, 0x49, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF6, 0xD5, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x73, 0x66, 0x33, 0x32, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x12, 0xE6, 0x00, 0x00, 0x09, 0xEF, 0xFF, 0xFF, 0xF6, 0x8D, 0x00, 0x00, 0x0E, 0x3A, 0x00, 0x00, 0xF6, 0xC8, 0xFF, 0xFF, 0xFC, 0x53, 0xFF, 0xFF, 0xFE, 0xE7, 0x00, 0x00, 0x01, 0x5B, 0x00, 0x00, 0xDC, 0xDF, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7C, 0x75, 0x00, 0x00, 0x3A, 0x08, 0xFF, 0xFF, 0xFF, 0xCB, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x52, 0xE8, 0x00, 0x00, 0xB5, 0xD8, 0x00, 0x00, 0x0B, 0x11, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x27, 0x79, 0x00, 0x00, 0x10, 0x20, 0x00, 0x00, 0xC8, 0x50, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
     
-    return create(dciP3Data, sizeof(dciP3Data));
+    if (isDefaultContext(context)) {
+        static auto profile = _makeImmortal(createStatic(dciP3Data, sizeof(dciP3Data)));
+        return profile;
+    }
+    
+    return internStatic(dciP3Data, sizeof(dciP3Data), context);
 }
 
 
-LCMSColorProfile* fn_nonnull LCMSColorProfile::createDCIP3D65() SWIFT_RETURNS_RETAINED {
+LCMSColorProfile* fn_nonnull LCMSColorProfile::createDCIP3D65(LCMSContext* fn_nullable context) SWIFT_RETURNS_RETAINED {
     static const unsigned char dciP3D65Data[] = { 0x00, 0x00, 0x02, 0x5C, 0x00, 0x00, 0x00, 0x00, 0x04, 0x30, 0x00, 0x00, 0x6D, 0x6E, 0x74, 0x72, 0x52, 0x47, 0x42, 0x20, 0x58, 0x59, 0x5A, 0x20, 0x07, 0xE1, 0x00, 0x06, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x61, 0x63, 0x73, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0xF6, 0xD6, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x43, 0x49, 0x47, 0x4C, 0x87, 0x78, 0x27, 0x40, 0xF3, 0xE3, 0xD1, 0x78, 0x46, 0x4D, 0x70, 0x67, 0xE9, 0xA2, 0x71, 0xE8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0B, 0x63, 0x70, 0x72, 0x74, 0x00, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x64, 0x64, 0x65, 0x73, 0x63, 0x00, 0x00, 0x01, 0x6C, 0x00, 0x00, 0x00, 0x30, 0x77, 0x74, 0x70, 0x74, 0x00, 0x00, 0x01, 0x9C, 0x00, 0x00, 0x00, 0x14, 0x63, 0x68, 0x61, 0x64, 0x00, 0x00, 0x01, 0xB0, 0x00, 0x00, 0x00, 0x2C, 0x72, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xDC, 0x00, 0x00, 0x00, 0x10, 0x67, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xEC, 0x00, 0x00, 0x00, 0x10, 0x62, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xFC, 0x00, 0x00, 0x00, 0x10, 0x72, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x0C, 0x00, 0x00, 0x00, 0x14, 0x67, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x20, 0x00, 0x00, 0x00, 0x14, 0x62, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x34, 0x00, 0x00, 0x00, 0x14, 0x6C, 0x75, 0x6D, 0x69, 0x00, 0x00, 0x02, 0x48, 0x00, 0x00, 0x00, 0x14, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x4B, 0x00, 0x00, 0x00, 0x48, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x72, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x74, 0x00, 0x69, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x6C, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6C, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x73, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x74, 0x00, 0x69, 0x00, 0x75, 0x00, 0x6D, 0x00, 0x2C, 0x00, 0x20, 0x00, 0x32, 0x00, 0x30, 0x00, 0x31, 0x00, 0x37, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x4B, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x44, 0x00, 0x43, 0x00, 0x49, 0x00, 0x20, 0x00, 0x50, 0x00, 0x33, 0x00, 0x20, 0x00, 0x44, 0x00, 0x36, 0x00, 0x35, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF6, 0xD5, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x73, 0x66, 0x33, 0x32, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0C, 0x44, 0x00, 0x00, 0x05, 0xDF, 0xFF, 0xFF, 0xF3, 0x26, 0x00, 0x00, 0x07, 0x94, 0x00, 0x00, 0xFD, 0x8F, 0xFF, 0xFF, 0xFB, 0xA1, 0xFF, 0xFF, 0xFD, 0xA2, 0x00, 0x00, 0x03, 0xDB, 0x00, 0x00, 0xC0, 0x75, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x83, 0xDF, 0x00, 0x00, 0x3D, 0xBF, 0xFF, 0xFF, 0xFF, 0xBB, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4A, 0xBF, 0x00, 0x00, 0xB1, 0x37, 0x00, 0x00, 0x0A, 0xB9, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x28, 0x38, 0x00, 0x00, 0x11, 0x0B, 0x00, 0x00, 0xC8, 0xB9, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
     
-    return create(dciP3D65Data, sizeof(dciP3D65Data));
+    if (isDefaultContext(context)) {
+        static auto profile = _makeImmortal(createStatic(dciP3D65Data, sizeof(dciP3D65Data)));
+        return profile;
+    }
+    
+    return internStatic(dciP3D65Data, sizeof(dciP3D65Data), context);
 }
 
 
 LCMSColorProfile* fn_nullable LCMSColorProfile::createLinear(bool force) SWIFT_RETURNS_RETAINED {
-    cmsSetLogErrorHandler([](struct _cmsContext_struct *, unsigned int, const char * message) {
-        if (message) {
-            printf("Error: %s\n", message);
-        }
-        else {
-            printf("Unknown error\n");
-        }
-    });
-    
     // TODO: This method produces a different colour profile that messes up the colours even if this colour profile is already linear
     
     // Check if the colour profile is already linear
@@ -201,8 +663,11 @@ LCMSColorProfile* fn_nullable LCMSColorProfile::createLinear(bool force) SWIFT_R
         }
     }
     
-    // Load lcms color profile
-    cmsHPROFILE srcProfile = cmsOpenProfileFromMem(_data, static_cast<cmsUInt32Number>(_size));
+    // Errors of the profile's context go to the parent while its tags are read
+    LCMSLogScope log(_parentContext);
+    
+    // Get lcms color profile
+    cmsHPROFILE srcProfile = getHandle();
     if (srcProfile == nullptr) {
         printf("Could not open ICC profile\n");
         return nullptr;
@@ -212,7 +677,6 @@ LCMSColorProfile* fn_nullable LCMSColorProfile::createLinear(bool force) SWIFT_R
     cmsCIExyY whitePoint;
     if (tag_reader::read(srcProfile, whitePoint, cmsSigMediaWhitePointTag) == false) {
         printf("Could not read white point tag\n");
-        cmsCloseProfile(srcProfile);
         return nullptr;
     }
     
@@ -220,25 +684,22 @@ LCMSColorProfile* fn_nullable LCMSColorProfile::createLinear(bool force) SWIFT_R
     cmsCIExyYTRIPLE primaries = { };
     if (tag_reader::read(srcProfile, primaries.Red, cmsSigRedColorantTag) == false) {
         printf("Could not read red colorant tag\n");
-        cmsCloseProfile(srcProfile);
         return nullptr;
     }
     if (tag_reader::read(srcProfile, primaries.Green, cmsSigGreenColorantTag) == false) {
         printf("Could not read green colorant tag\n");
-        cmsCloseProfile(srcProfile);
         return nullptr;
     }
     if (tag_reader::read(srcProfile, primaries.Blue, cmsSigBlueColorantTag) == false) {
         printf("Could not read green colorant tag\n");
-        cmsCloseProfile(srcProfile);
         return nullptr;
     }
     
     // Linear transfer function
-    cmsToneCurve* linear = cmsBuildGamma(nullptr, 1.0);
+    LCMSMemoryScope memory(_parentContext->getMemoryTracker(), LCMSMemoryCategory::profiles);
+    cmsToneCurve* linear = cmsBuildGamma(_context.get(), 1.0);
     if (linear == nullptr) {
         printf("Could not create linear gamma\n");
-        cmsCloseProfile(srcProfile);
         return nullptr;
     }
     cmsToneCurve* transferFunction[3] = { linear, linear, linear };
@@ -252,11 +713,10 @@ LCMSColorProfile* fn_nullable LCMSColorProfile::createLinear(bool force) SWIFT_R
 #endif
     
     // Create linear profile
-    cmsHPROFILE dstProfile = cmsCreateRGBProfile(&whitePoint, &primaries, transferFunction);
+    cmsHPROFILE dstProfile = cmsCreateRGBProfileTHR(_context.get(), &whitePoint, &primaries, transferFunction);
     if (dstProfile == nullptr) {
         printf("Could not create linear ICC profile\n");
         cmsFreeToneCurve(linear);
-        cmsCloseProfile(srcProfile);
         return nullptr;
     }
     
@@ -267,7 +727,6 @@ LCMSColorProfile* fn_nullable LCMSColorProfile::createLinear(bool force) SWIFT_R
         printf("Could not prepare ICC profile for serialisation\n");
         cmsCloseProfile(dstProfile);
         cmsFreeToneCurve(linear);
-        cmsCloseProfile(srcProfile);
         return nullptr;
     }
     
@@ -279,18 +738,16 @@ LCMSColorProfile* fn_nullable LCMSColorProfile::createLinear(bool force) SWIFT_R
         delete [] profileData;
         cmsCloseProfile(dstProfile);
         cmsFreeToneCurve(linear);
-        cmsCloseProfile(srcProfile);
         return nullptr;
     }
     
     // Create profile
-    auto profile = LCMSColorProfile::create(profileData, profileSize);
+    auto profile = LCMSColorProfile::create(profileData, profileSize, _parentContext);
     
     // Clean up
     delete [] profileData;
     cmsCloseProfile(dstProfile);
     cmsFreeToneCurve(linear);
-    cmsCloseProfile(srcProfile);
     
     // Return profile
     return profile;
@@ -298,8 +755,8 @@ LCMSColorProfile* fn_nullable LCMSColorProfile::createLinear(bool force) SWIFT_R
 
 
 bool LCMSColorProfile::checkIsLinear() {
-    // Load lcms color profile
-    cmsHPROFILE srcProfile = cmsOpenProfileFromMem(_data, static_cast<cmsUInt32Number>(_size));
+    // Get lcms color profile
+    cmsHPROFILE srcProfile = getHandle();
     if (srcProfile == nullptr) {
         printf("Could not open ICC profile\n");
         return false;
@@ -316,8 +773,6 @@ bool LCMSColorProfile::checkIsLinear() {
         isLinear = cmsIsToneCurveLinear(redTRC) && cmsIsToneCurveLinear(greenTRC) && cmsIsToneCurveLinear(blueTRC);
     }
     
-    cmsCloseProfile(srcProfile);
-    
     return isLinear;
 }
 
@@ -391,8 +846,8 @@ static bool nearlyEqual(float a, float b, float threshold = 0.00001) {
 
 
 bool LCMSColorProfile::checkIsSRGB() {
-    // Load lcms color profile
-    cmsHPROFILE srcProfile = cmsOpenProfileFromMem(_data, static_cast<cmsUInt32Number>(_size));
+    // Get lcms color profile
+    cmsHPROFILE srcProfile = getHandle();
     if (srcProfile == nullptr) {
         printf("Could not open ICC profile\n");
         return false;
@@ -404,21 +859,18 @@ bool LCMSColorProfile::checkIsSRGB() {
         auto redTRC = tag_reader::readToneCurve(srcProfile, cmsSigRedTRCTag);
         if (redTRC == nullptr) {
             printf("Could not read red tone curve\n");
-            cmsCloseProfile(srcProfile);
             return false;
         }
         
         auto greenTRC = tag_reader::readToneCurve(srcProfile, cmsSigGreenTRCTag);
         if (greenTRC == nullptr) {
             printf("Could not read green tone curve\n");
-            cmsCloseProfile(srcProfile);
             return false;
         }
         
         auto blueTRC = tag_reader::readToneCurve(srcProfile, cmsSigBlueTRCTag);
         if (blueTRC == nullptr) {
             printf("Could not read blue tone curve\n");
-            cmsCloseProfile(srcProfile);
             return false;
         }
         
@@ -428,21 +880,18 @@ bool LCMSColorProfile::checkIsSRGB() {
         auto rGamma = cmsEstimateGamma(redTRC, 0.1);
         if (nearlyEqual(rGamma, 2.2017832637391117, 0.00001) == false) {
             printf("Red channel gamma %.5f does not match sRGB gamma ~2.20178\n", rGamma);
-            cmsCloseProfile(srcProfile);
             return false;
         }
         
         auto gGamma = cmsEstimateGamma(greenTRC, 0.1);
         if (nearlyEqual(gGamma, 2.2017832637391117, 0.00001) == false) {
             printf("Green channel gamma %.5f does not match sRGB gamma ~2.20178\n", gGamma);
-            cmsCloseProfile(srcProfile);
             return false;
         }
         
         auto bGamma = cmsEstimateGamma(blueTRC, 0.1);
         if (nearlyEqual(bGamma, 2.2017832637391117, 0.00001) == false) {
             printf("Blue channel gamma %.5f does not match sRGB gamma ~2.20178\n", bGamma);
-            cmsCloseProfile(srcProfile);
             return false;
         }
         
@@ -450,7 +899,6 @@ bool LCMSColorProfile::checkIsSRGB() {
         auto gamma = cmsDetectRGBProfileGamma(srcProfile, 0.1);
         if (nearlyEqual(gamma, 2.2017296101185178, 0.00001) == false) {
             printf("Gamma %.5f does not match sRGB gamma ~2.20172\n", gamma);
-            cmsCloseProfile(srcProfile);
             return false;
         }
     }
@@ -499,7 +947,6 @@ bool LCMSColorProfile::checkIsSRGB() {
         auto chromacity = tag_reader::readTag<cmsCIExyYTRIPLE>(srcProfile, cmsSigChromaticityTag);
         if (chromacity == nullptr) {
             printf("Could not read chromacity tag\n");
-            cmsCloseProfile(srcProfile);
             return false;
         }
         
@@ -520,14 +967,10 @@ bool LCMSColorProfile::checkIsSRGB() {
             nearlyEqual(chromacity->Blue.Y, 1) == false
             ) {
                 printf("Colour primaries do not match sRGB primaries\n");
-                cmsCloseProfile(srcProfile);
                 return false;
             }
     }
     
-    // Clean up
-    cmsCloseProfile(srcProfile);
-    
     // It's very likely that it's an sRGB colour profile
     return true;
 }
@@ -538,6 +981,11 @@ LCMSColorProfile* fn_nullable LCMSColorProfileRetain(LCMSColorProfile* fn_nullab
         return nullptr;
     }
     
+    // Built-in profiles are shared by every thread, so they skip the counter instead of contending on it
+    if (value->_immortal) {
+        return value;
+    }
+    
     value->_referenceCounter.fetch_add(1);
     return value;
 }
@@ -548,6 +996,10 @@ void LCMSColorProfileRelease(LCMSColorProfile* fn_nullable value) {
         return;
     }
     
+    if (value->_immortal) {
+        return;
+    }
+    
     if (value->_referenceCounter.fetch_sub(1) == 1) {
         delete value;
     }
@@ -0,0 +1,63 @@
+//
+//  ComponentConverter.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include "HalfFormatters.hpp"
+#include <lcms2.h>
+
+
+/// Maps the wrapper's interleaved pixel layouts to lcms pixel formats.
+struct ComponentConverter {
+    static cmsUInt32Number C1(long componentSize) {
+        switch (componentSize) {
+            case 1: return TYPE_GRAY_8;
+            case 2: return TYPE_GRAY_HALF_FLT;
+            case 4: return TYPE_GRAY_FLT;
+            default: return 0;
+        }
+    }
+    
+    static cmsUInt32Number C2(long componentSize) {
+        switch (componentSize) {
+            case 1: return TYPE_GRAYA_8;
+            case 2: return TYPE_GRAYA_HALF_FLT;
+            case 4: return TYPE_GRAYA_FLT;
+            default: return 0;
+        }
+    }
+    
+    static cmsUInt32Number C3(long componentSize) {
+        switch (componentSize) {
+            case 1: return TYPE_RGB_8;
+            case 2: return TYPE_RGB_HALF_FLT;
+            case 4: return TYPE_RGB_FLT;
+            default: return 0;
+        }
+    }
+    
+    static cmsUInt32Number C4(long componentSize) {
+        switch (componentSize) {
+            case 1: return TYPE_RGBA_8;
+            case 2: return TYPE_RGBA_HALF_FLT;
+            case 4: return TYPE_RGBA_FLT;
+            default: return 0;
+        }
+    }
+    
+    // TODO: Add flag for alpha (true = alpha is ignored (TYPE_RGBA_8), false = convert alpha (TYPE_RGBA_8_PLANAR))
+    static cmsUInt32Number calculate(long numComponents, long componentSize) {
+        switch (numComponents) {
+            case 1: return ComponentConverter::C1(componentSize);
+            case 2: return ComponentConverter::C2(componentSize);
+            case 3: return ComponentConverter::C3(componentSize);
+            case 4: return ComponentConverter::C4(componentSize);
+            default: return 0;
+        }
+    }
+    
+};
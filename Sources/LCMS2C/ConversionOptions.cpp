@@ -0,0 +1,99 @@
+//
+//  ConversionOptions.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "ConversionOptions.hpp"
+
+
+LCMSConversionOptions LCMSConversionOptions::exact() {
+    LCMSConversionOptions options;
+    options.precalculation = LCMSPrecalculation::none;
+    return options;
+}
+
+
+LCMSConversionOptions LCMSConversionOptions::balanced() {
+    return LCMSConversionOptions();
+}
+
+
+LCMSConversionOptions LCMSConversionOptions::fast() {
+    LCMSConversionOptions options;
+    options.precalculation = LCMSPrecalculation::normal;
+    return options;
+}
+
+
+bool lcmsConversionFlags(const LCMSConversionOptions& options, LCMSConversionPlan plan, cmsUInt32Number& flags) {
+    if (options.intent < LCMSRenderingIntent::perceptual || options.intent > LCMSRenderingIntent::absoluteColorimetric) {
+        printf("Invalid rendering intent: %ld\n", static_cast<long>(options.intent));
+        return false;
+    }
+    
+    if (options.precalculation < LCMSPrecalculation::automatic || options.precalculation > LCMSPrecalculation::high) {
+        printf("Invalid precalculation: %ld\n", static_cast<long>(options.precalculation));
+        return false;
+    }
+    
+    if (options.gamutMaskFormat < LCMSGamutMaskFormat::bit || options.gamutMaskFormat > LCMSGamutMaskFormat::byte) {
+        printf("Invalid gamut mask format: %ld\n", static_cast<long>(options.gamutMaskFormat));
+        return false;
+    }
+    
+    if (options.gridPoints != 0 && (options.gridPoints < 2 || options.gridPoints > 255)) {
+        printf("Invalid number of grid points: %ld\n", options.gridPoints);
+        return false;
+    }
+    
+    // Transforms are shared between threads, so disable the 1-pixel cache
+    flags = cmsFLAGS_NOCACHE;
+    
+    // TODO: Check if image contains alpha channel
+    if (true) {
+        flags |= cmsFLAGS_COPY_ALPHA;
+    }
+    
+    if (options.blackPointCompensation) {
+        flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
+    }
+    
+    if (options.whiteOnWhiteFixup == false) {
+        flags |= cmsFLAGS_NOWHITEONWHITEFIXUP;
+    }
+    
+    if (options.clipNegatives) {
+        flags |= cmsFLAGS_NONEGATIVES;
+    }
+    
+    switch (plan) {
+        case LCMSConversionPlan::exact:
+            flags |= cmsFLAGS_NOOPTIMIZE;
+            break;
+            
+        case LCMSConversionPlan::lowResolution:
+            flags |= cmsFLAGS_LOWRESPRECALC;
+            break;
+            
+        case LCMSConversionPlan::normal:
+            break;
+            
+        case LCMSConversionPlan::highResolution:
+            flags |= cmsFLAGS_HIGHRESPRECALC;
+            break;
+            
+        case LCMSConversionPlan::formatOnly:
+            flags |= cmsFLAGS_NULLTRANSFORM;
+            break;
+    }
+    
+    // Explicit grid points take precedence over the lcms presets
+    if (options.gridPoints != 0) {
+        flags &= ~(cmsFLAGS_LOWRESPRECALC | cmsFLAGS_HIGHRESPRECALC);
+        flags |= cmsFLAGS_GRIDPOINTS(options.gridPoints);
+    }
+    
+    return true;
+}
@@ -0,0 +1,22 @@
+//
+//  ConversionOptions.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/ConversionOptions.hpp>
+#include <lcms2.h>
+
+
+/// lcms transform flags for the conversion `options` built with the precalculation `plan`.
+///
+/// Returns `false` if the options are invalid.
+bool lcmsConversionFlags(const LCMSConversionOptions& options, LCMSConversionPlan plan, cmsUInt32Number& flags);
+
+
+static inline cmsUInt32Number lcmsConversionIntent(const LCMSConversionOptions& options) {
+    return static_cast<cmsUInt32Number>(options.intent);
+}
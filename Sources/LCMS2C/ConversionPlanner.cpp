@@ -0,0 +1,235 @@
+//
+//  ConversionPlanner.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "ConversionPlanner.hpp"
+#include "TransformCache.hpp"
+#include "ProfileHandle.hpp"
+#include <cmath>
+#include <algorithm>
+
+
+// Rough costs in nanoseconds for RGB pixels, measured on top of the exact plan. Only their ratios matter.
+
+/// Evaluating a pipeline stage by stage, per pixel or lookup table node.
+static constexpr double matrixShaperEvaluationCost = 500;
+static constexpr double clutEvaluationCost = 900;
+
+/// Interpolating a precalculated 8-bit lookup table per pixel.
+static constexpr double lookupTableEvaluationCost = 60;
+
+/// lcms prelinearizes the inputs of 8-bit RGB lookup tables, which costs the same whatever the table size.
+static constexpr double prelinearizationBuildCost = 100'000'000;
+
+/// lcms turns 8-bit matrix-shaper pairs into fixed point curves and matrix instead of a lookup table, unless negative values are clipped.
+static constexpr double fixedPointMatrixShaperCost = 30;
+static constexpr double fixedPointMatrixShaperBuildCost = 4'500'000;
+
+/// Float RGB matrix-shaper pairs take the matrix-shaper kernel, which samples its curve tables when it's built.
+static constexpr double matrixShaperKernelCost = 40;
+static constexpr double matrixShaperKernelBuildCost = 5'000'000;
+
+/// Pixel count assumed for transforms that are reused, like the ones created directly through `LCMSTransform`.
+static constexpr double reusedTransformNumPixels = 64.0 * 1024 * 1024;
+
+/// Larger tables are more accurate, so they are preferred as long as they cost at most this much more than the cheapest plan.
+static constexpr double accuracyAllowance = 1.1;
+
+/// Largest difference of colorant and white point XYZ values of equivalent profiles. Covers the rounding of different profile writers.
+static constexpr double colorantTolerance = 1.0 / 512;
+
+/// Largest difference of the tone curves of equivalent profiles, a quarter of an 8-bit step.
+static constexpr float curveTolerance = 1.0f / 1024;
+static constexpr int numCurveSamples = 256;
+
+
+/// Grid points lcms uses per input channel for the plan.
+static double gridPoints(LCMSConversionPlan plan) {
+    switch (plan) {
+        case LCMSConversionPlan::lowResolution: return 17;
+        case LCMSConversionPlan::highResolution: return 49;
+        default: return 33;
+    }
+}
+
+
+static LCMSConversionPlan planAutomatically(const LCMSConversionOptions& options, const LCMSConversionTraits& traits) {
+    auto matrixShapers = traits.sourceIsMatrixShaper && traits.targetIsMatrixShaper;
+    auto rgb = T_CHANNELS(traits.inputFormat) == 3 && T_CHANNELS(traits.outputFormat) == 3;
+    auto evaluationCost = matrixShapers ? matrixShaperEvaluationCost : clutEvaluationCost;
+    auto numPixels = traits.numPixels > 0 ? static_cast<double>(traits.numPixels) : reusedTransformNumPixels;
+    auto numChannels = static_cast<double>(T_CHANNELS(traits.inputFormat));
+    
+    auto bestPlan = LCMSConversionPlan::exact;
+    auto bestCost = numPixels * evaluationCost;
+    
+    // lcms never resamples float pipelines, it only simplifies them losslessly. Only the kernel has to be built first
+    if (T_FLOAT(traits.inputFormat) || T_FLOAT(traits.outputFormat)) {
+        if (matrixShapers && rgb && T_FLOAT(traits.inputFormat) && T_FLOAT(traits.outputFormat)) {
+            auto cost = matrixShaperKernelBuildCost + numPixels * matrixShaperKernelCost;
+            return cost < bestCost ? LCMSConversionPlan::normal : LCMSConversionPlan::exact;
+        }
+        return LCMSConversionPlan::normal;
+    }
+    
+    // The fixed point path doesn't depend on the precalculation resolution
+    if (matrixShapers && options.clipNegatives == false && T_BYTES(traits.inputFormat) == 1 && T_BYTES(traits.outputFormat) == 1) {
+        auto cost = fixedPointMatrixShaperBuildCost + numPixels * fixedPointMatrixShaperCost;
+        return cost < bestCost ? LCMSConversionPlan::normal : LCMSConversionPlan::exact;
+    }
+    
+    auto buildCost = rgb ? prelinearizationBuildCost : 0;
+    for (auto plan: { LCMSConversionPlan::lowResolution, LCMSConversionPlan::normal, LCMSConversionPlan::highResolution }) {
+        auto numNodes = std::pow(gridPoints(plan), numChannels);
+        auto cost = buildCost + numNodes * evaluationCost + numPixels * lookupTableEvaluationCost;
+        if (cost <= bestCost * accuracyAllowance) {
+            bestPlan = plan;
+            bestCost = std::min(bestCost, cost);
+        }
+    }
+    
+    return bestPlan;
+}
+
+
+LCMSConversionPlan lcmsPlanConversion(const LCMSConversionOptions& options, const LCMSConversionTraits& traits) {
+    if (traits.profileMatch == LCMSProfileMatch::identical ||
+        (traits.profileMatch == LCMSProfileMatch::equivalent && options.precalculation != LCMSPrecalculation::none)) {
+        return LCMSConversionPlan::formatOnly;
+    }
+    
+    switch (options.precalculation) {
+        case LCMSPrecalculation::none: return LCMSConversionPlan::exact;
+        case LCMSPrecalculation::low: return LCMSConversionPlan::lowResolution;
+        case LCMSPrecalculation::normal: return LCMSConversionPlan::normal;
+        case LCMSPrecalculation::high: return LCMSConversionPlan::highResolution;
+        default: return planAutomatically(options, traits);
+    }
+}
+
+
+static bool closeEnough(const cmsCIEXYZ& a, const cmsCIEXYZ& b) {
+    return std::abs(a.X - b.X) <= colorantTolerance && std::abs(a.Y - b.Y) <= colorantTolerance && std::abs(a.Z - b.Z) <= colorantTolerance;
+}
+
+
+static bool readXYZ(cmsHPROFILE fn_nonnull profile, cmsTagSignature tag, cmsCIEXYZ& value) {
+    auto data = cmsIsTag(profile, tag) ? static_cast<const cmsCIEXYZ*>(cmsReadTag(profile, tag)) : nullptr;
+    if (data == nullptr) {
+        return false;
+    }
+    
+    value = *data;
+    return true;
+}
+
+
+/// White point absolute colorimetric conversions adapt to. Like lcms, V2 display profiles are taken as D50.
+static cmsCIEXYZ mediaWhitePoint(cmsHPROFILE fn_nonnull profile) {
+    cmsCIEXYZ whitePoint = *cmsD50_XYZ();
+    if (cmsGetEncodedICCversion(profile) < 0x4000000 && cmsGetDeviceClass(profile) == cmsSigDisplayClass) {
+        return whitePoint;
+    }
+    
+    readXYZ(profile, cmsSigMediaWhitePointTag, whitePoint);
+    return whitePoint;
+}
+
+
+static bool curvesMatch(cmsHPROFILE fn_nonnull a, cmsHPROFILE fn_nonnull b, cmsTagSignature tag) {
+    auto curveA = cmsIsTag(a, tag) ? static_cast<const cmsToneCurve*>(cmsReadTag(a, tag)) : nullptr;
+    auto curveB = cmsIsTag(b, tag) ? static_cast<const cmsToneCurve*>(cmsReadTag(b, tag)) : nullptr;
+    if (curveA == nullptr || curveB == nullptr) {
+        return false;
+    }
+    
+    for (int i = 0; i <= numCurveSamples; i++) {
+        auto x = static_cast<float>(i) / numCurveSamples;
+        if (std::abs(cmsEvalToneCurveFloat(curveA, x) - cmsEvalToneCurveFloat(curveB, x)) > curveTolerance) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+
+static LCMSProfileMatch matchProfiles(cmsHPROFILE fn_nonnull a, cmsHPROFILE fn_nonnull b, cmsUInt32Number intent) {
+    // Only matrix-shapers are described by a handful of tags
+    if (cmsGetColorSpace(a) != cmsSigRgbData || cmsGetColorSpace(b) != cmsSigRgbData ||
+        cmsIsMatrixShaper(a) == false || cmsIsMatrixShaper(b) == false) {
+        return LCMSProfileMatch::different;
+    }
+    
+    for (auto tag: { cmsSigRedColorantTag, cmsSigGreenColorantTag, cmsSigBlueColorantTag }) {
+        cmsCIEXYZ colorantA;
+        cmsCIEXYZ colorantB;
+        if (readXYZ(a, tag, colorantA) == false || readXYZ(b, tag, colorantB) == false || closeEnough(colorantA, colorantB) == false) {
+            return LCMSProfileMatch::different;
+        }
+    }
+    
+    // Other intents map white to white
+    if (intent == INTENT_ABSOLUTE_COLORIMETRIC && closeEnough(mediaWhitePoint(a), mediaWhitePoint(b)) == false) {
+        return LCMSProfileMatch::different;
+    }
+    
+    for (auto tag: { cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag }) {
+        if (curvesMatch(a, b, tag) == false) {
+            return LCMSProfileMatch::different;
+        }
+    }
+    
+    return LCMSProfileMatch::equivalent;
+}
+
+
+LCMSProfilePairTraits lcmsInspectProfiles(LCMSColorProfile* fn_nullable source, LCMSColorProfile* fn_nullable target, cmsUInt32Number intent) {
+    auto a = lcmsProfileHandle(source);
+    auto b = lcmsProfileHandle(target);
+    
+    LCMSProfilePairTraits traits = {
+        .sourceIsMatrixShaper = a && cmsIsMatrixShaper(a),
+        .targetIsMatrixShaper = b && cmsIsMatrixShaper(b),
+        .targetIsRGBMatrixShaper = b && cmsIsMatrixShaper(b) && cmsGetColorSpace(b) == cmsSigRgbData,
+        .profileMatch = LCMSProfileMatch::different
+    };
+    
+    if (source == target || LCMSTransformKey::identify(source) == LCMSTransformKey::identify(target)) {
+        traits.profileMatch = LCMSProfileMatch::identical;
+    }
+    else if (a && b) {
+        traits.profileMatch = matchProfiles(a, b, intent);
+    }
+    
+    return traits;
+}
+
+
+LCMSProfilePairTraits LCMSProfilePairCache::get(LCMSColorProfile* fn_nullable source, LCMSColorProfile* fn_nullable target, cmsUInt32Number intent) {
+    Key key = {
+        .sourceProfile = LCMSTransformKey::identify(source),
+        .targetProfile = LCMSTransformKey::identify(target),
+        .intent = intent
+    };
+    {
+        std::lock_guard lock(_mutex);
+        auto entry = _entries.find(key);
+        if (entry != _entries.end()) {
+            return entry->second;
+        }
+    }
+    
+    // Inspected without the lock, threads that race here get the same result
+    auto traits = lcmsInspectProfiles(source, target, intent);
+    
+    std::lock_guard lock(_mutex);
+    if (_entries.size() >= capacity) {
+        _entries.clear();
+    }
+    _entries.emplace(key, traits);
+    return traits;
+}
@@ -0,0 +1,97 @@
+//
+//  ConversionPlanner.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/ConversionOptions.hpp>
+#include <LCMS2C/ColorProfile.hpp>
+#include <lcms2.h>
+#include <mutex>
+#include <unordered_map>
+
+
+class LCMSContext;
+
+
+/// How close the source and target profiles of a conversion are.
+enum class LCMSProfileMatch: long {
+    different = 0,
+    
+    /// Primaries, tone curves and, for absolute colorimetric conversions, white points agree within a tolerance that's invisible in 8-bit pixels.
+    equivalent,
+    
+    /// Same profile ID.
+    identical
+};
+
+
+/// What the planner knows about a conversion.
+struct LCMSConversionTraits {
+    /// Number of pixels the transform is expected to process. `0` stands for a transform that is reused a lot.
+    long numPixels;
+    cmsUInt32Number inputFormat;
+    cmsUInt32Number outputFormat;
+    bool sourceIsMatrixShaper;
+    bool targetIsMatrixShaper;
+    LCMSProfileMatch profileMatch;
+};
+
+
+/// Plan for the conversion `options`, asking the cost model if the precalculation is automatic.
+///
+/// Conversions between identical profiles are always format-only, between equivalent profiles unless the options ask for the exact reference path.
+LCMSConversionPlan lcmsPlanConversion(const LCMSConversionOptions& options, const LCMSConversionTraits& traits);
+
+
+/// What the planner and the gamut check know about the profiles of a conversion. Only depends on the profile IDs and the intent.
+struct LCMSProfilePairTraits {
+    bool sourceIsMatrixShaper;
+    bool targetIsMatrixShaper;
+    
+    /// The target gamut is a box in linear RGB.
+    bool targetIsRGBMatrixShaper;
+    
+    LCMSProfileMatch profileMatch;
+};
+
+
+/// Profile pair traits of the conversions of a context, so that profiles aren't inspected on every transform creation. Every `LCMSContext` has its own.
+class LCMSProfilePairCache final {
+private:
+    struct Key {
+        LCMSProfileID sourceProfile;
+        LCMSProfileID targetProfile;
+        cmsUInt32Number intent;
+        
+        bool operator==(const Key& other) const = default;
+    };
+    
+    struct Hash {
+        size_t operator()(const Key& key) const { return static_cast<size_t>(key.sourceProfile.high ^ key.sourceProfile.low ^ (key.targetProfile.high * 31) ^ key.targetProfile.low ^ key.intent); }
+    };
+    
+    std::mutex _mutex;
+    std::unordered_map<Key, LCMSProfilePairTraits, Hash> _entries;
+    
+public:
+    /// Traits are a few bytes, the table is only emptied when it reaches this size.
+    static constexpr size_t capacity = 4096;
+    
+    LCMSProfilePairCache() = default;
+    
+    LCMSProfilePairCache(const LCMSProfilePairCache&) = delete;
+    LCMSProfilePairCache& operator=(const LCMSProfilePairCache&) = delete;
+    
+    /// Returns the traits of the profiles with the `intent`, inspecting them on the first call. `nullptr` stands for the built-in sRGB profile.
+    LCMSProfilePairTraits get(LCMSColorProfile* fn_nullable source, LCMSColorProfile* fn_nullable target, cmsUInt32Number intent);
+};
+
+
+/// Inspects the profiles of a conversion with the `intent`. `nullptr` stands for the built-in sRGB profile.
+///
+/// Different profile IDs are only compared further for RGB matrix-shaper profiles. Use the context's ``LCMSProfilePairCache`` instead of calling it for every transform.
+LCMSProfilePairTraits lcmsInspectProfiles(LCMSColorProfile* fn_nullable source, LCMSColorProfile* fn_nullable target, cmsUInt32Number intent);
@@ -0,0 +1,236 @@
+//
+//  GamutCheck.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "GamutCheck.hpp"
+#include <LCMS2C/LCMSContext.hpp>
+#include "ProfileHandle.hpp"
+#include "ConversionPlanner.hpp"
+#include "MatrixShaper.hpp"
+#include <cstring>
+#include <algorithm>
+
+
+/// Largest colour difference, in ΔE 1976, that still counts as in gamut.
+static constexpr float gamutTolerance = 2.0f;
+
+
+LCMSGamutChecker::LCMSGamutChecker(LCMSTransformReference transform):
+_transform(std::move(transform)),
+_fusedKernel(nullptr),
+_probeKernel(nullptr),
+_numInputComponents(0),
+_widenInput(false),
+_numTargetChannels(0) {
+    //
+}
+
+
+/// Builds a transform, where `nullptr` profiles are replaced by sRGB and `lab` stands for the Lab profile.
+static LCMSTransformReference createCachedTransform(LCMSContext* fn_nonnull context, const LCMSTransformKey& key,
+                                                    LCMSColorProfile* fn_nullable sourceColorProfile, bool sourceIsLab,
+                                                    LCMSColorProfile* fn_nullable targetColorProfile, bool targetIsLab) {
+    auto contextHandle = context->getThreadHandle();
+    return context->getTransformCache().get(key, [&]() -> LCMSTransformReference {
+        auto lab = cmsCreateLab4ProfileTHR(contextHandle, nullptr);
+        
+        auto sourceHandle = sourceIsLab ? lab : lcmsProfileHandle(sourceColorProfile);
+        auto targetHandle = targetIsLab ? lab : lcmsProfileHandle(targetColorProfile);
+        cmsHTRANSFORM transform = nullptr;
+        if (sourceHandle && targetHandle) {
+            transform = cmsCreateTransformTHR(contextHandle,
+                                              sourceHandle, key.inputFormat,
+                                              targetHandle, key.outputFormat,
+                                              key.intent,
+                                              key.flags);
+        }
+        
+        if (lab) {
+            cmsCloseProfile(lab);
+        }
+        
+        if (transform == nullptr) {
+            return nullptr;
+        }
+        
+        return std::make_shared<LCMSCachedTransform>(transform,
+                                                     sourceIsLab ? nullptr : sourceColorProfile,
+                                                     targetIsLab ? nullptr : targetColorProfile);
+    });
+}
+
+
+std::shared_ptr<LCMSGamutChecker> LCMSGamutChecker::create(LCMSContext* fn_nonnull context, LCMSTransformReference transform,
+                                                          LCMSColorProfile* fn_nullable sourceColorProfile, LCMSColorProfile* fn_nullable targetColorProfile,
+                                                          cmsUInt32Number inputFormat, cmsUInt32Number intent, cmsUInt32Number flags) {
+    // Known from the transform's creation, the target isn't inspected again
+    auto analytic = context->getProfilePairCache().get(sourceColorProfile, targetColorProfile, intent).targetIsRGBMatrixShaper;
+    auto checker = std::make_shared<LCMSGamutChecker>(transform);
+    
+    // The conversion takes the matrix-shaper fast path, the test comes for free
+    checker->_fusedKernel = analytic ? lcmsMatrixShaperKernel(transform->get()) : nullptr;
+    if (checker->_fusedKernel) {
+        return checker;
+    }
+    
+    auto sourceIdentity = LCMSTransformKey::identify(sourceColorProfile);
+    auto targetIdentity = LCMSTransformKey::identify(targetColorProfile);
+    
+    // The conversion is exact or works on 8-bit pixels. A float probe of the same conversion finds the linear target values
+    if (analytic && T_COLORSPACE(inputFormat) == PT_RGB) {
+        auto probeFormat = inputFormat;
+        if (T_FLOAT(inputFormat) == 0) {
+            probeFormat = FLOAT_SH(1) | COLORSPACE_SH(PT_RGB) | CHANNELS_SH(3) | EXTRA_SH(T_EXTRA(inputFormat)) | BYTES_SH(4);
+        }
+        
+        LCMSTransformKey probeKey = {
+            .sourceProfile = sourceIdentity,
+            .targetProfile = targetIdentity,
+            .inputFormat = probeFormat,
+            .outputFormat = TYPE_RGB_FLT,
+            .intent = intent,
+            .flags = cmsFLAGS_NOCACHE | (flags & cmsFLAGS_BLACKPOINTCOMPENSATION)
+        };
+        auto probe = createCachedTransform(context, probeKey, sourceColorProfile, false, targetColorProfile, false);
+        auto probeKernel = probe ? lcmsMatrixShaperKernel(probe->get()) : nullptr;
+        if (probeKernel) {
+            checker->_probe = std::move(probe);
+            checker->_probeKernel = probeKernel;
+            checker->_numInputComponents = T_CHANNELS(inputFormat) + T_EXTRA(inputFormat);
+            checker->_widenInput = T_FLOAT(inputFormat) == 0;
+            return checker;
+        }
+    }
+    
+    auto target = lcmsProfileHandle(targetColorProfile);
+    if (target == nullptr) {
+        printf("Could not create gamut check target profile\n");
+        return nullptr;
+    }
+    
+    // Lookup table targets. Device values of the target in float, so that values outside of the gamut aren't clipped on the way
+    auto targetFormat = cmsFormatterForColorspaceOfProfile(target, 4, true);
+    
+    // Gamut is a colorimetric property, so only absolute colorimetric is kept and everything else is checked relatively
+    cmsUInt32Number gamutIntent = intent == INTENT_ABSOLUTE_COLORIMETRIC ? INTENT_ABSOLUTE_COLORIMETRIC : INTENT_RELATIVE_COLORIMETRIC;
+    auto labIdentity = LCMSTransformKey::identifyLab();
+    
+    LCMSTransformKey sourceToLabKey = {
+        .sourceProfile = sourceIdentity,
+        .targetProfile = labIdentity,
+        .inputFormat = inputFormat,
+        .outputFormat = TYPE_Lab_FLT,
+        .intent = gamutIntent,
+        .flags = cmsFLAGS_NOCACHE
+    };
+    checker->_sourceToLab = createCachedTransform(context, sourceToLabKey, sourceColorProfile, false, nullptr, true);
+    
+    LCMSTransformKey sourceToTargetKey = {
+        .sourceProfile = sourceIdentity,
+        .targetProfile = targetIdentity,
+        .inputFormat = inputFormat,
+        .outputFormat = targetFormat,
+        .intent = gamutIntent,
+        .flags = cmsFLAGS_NOCACHE
+    };
+    checker->_sourceToTarget = createCachedTransform(context, sourceToTargetKey, sourceColorProfile, false, targetColorProfile, false);
+    
+    LCMSTransformKey targetToLabKey = {
+        .sourceProfile = targetIdentity,
+        .targetProfile = labIdentity,
+        .inputFormat = targetFormat,
+        .outputFormat = TYPE_Lab_FLT,
+        .intent = gamutIntent,
+        .flags = cmsFLAGS_NOCACHE
+    };
+    checker->_targetToLab = createCachedTransform(context, targetToLabKey, targetColorProfile, false, nullptr, true);
+    
+    if (checker->_sourceToLab == nullptr || checker->_sourceToTarget == nullptr || checker->_targetToLab == nullptr) {
+        printf("Could not create gamut check transforms\n");
+        return nullptr;
+    }
+    
+    checker->_numTargetChannels = T_CHANNELS(targetFormat);
+    return checker;
+}
+
+
+long LCMSGamutChecker::prepareScratch(long width, LCMSGamutScratch& scratch) const {
+    if (_fusedKernel) {
+        return 0;
+    }
+    
+    if (_probeKernel) {
+        scratch.source.resize(_widenInput ? width * _numInputComponents : 0);
+    }
+    else {
+        scratch.sourceLab.resize(width * 3);
+        scratch.target.resize(width * _numTargetChannels);
+        scratch.targetLab.resize(width * 3);
+    }
+    
+    auto numFloats = scratch.source.capacity() + scratch.sourceLab.capacity() + scratch.target.capacity() + scratch.targetLab.capacity();
+    return static_cast<long>(numFloats * sizeof(float));
+}
+
+
+void LCMSGamutChecker::_checkRoundTrip(const void* fn_nonnull source, unsigned char* fn_nonnull mask, long width, LCMSGamutMaskFormat format, LCMSGamutScratch& scratch) const {
+    scratch.sourceLab.resize(width * 3);
+    scratch.target.resize(width * _numTargetChannels);
+    scratch.targetLab.resize(width * 3);
+    
+    auto numPixels = static_cast<cmsUInt32Number>(width);
+    cmsDoTransform(_sourceToLab->get(), source, scratch.sourceLab.data(), numPixels);
+    cmsDoTransform(_sourceToTarget->get(), source, scratch.target.data(), numPixels);
+    
+    // What the target can actually show
+    for (auto& value: scratch.target) {
+        value = std::clamp(value, 0.0f, 1.0f);
+    }
+    cmsDoTransform(_targetToLab->get(), scratch.target.data(), scratch.targetLab.data(), numPixels);
+    
+    unsigned char outOfGamut[256];
+    for (long first = 0; first < width; first += 256) {
+        auto count = std::min(256l, width - first);
+        for (long i = 0; i < count; i++) {
+            auto expected = &scratch.sourceLab[(first + i) * 3];
+            auto actual = &scratch.targetLab[(first + i) * 3];
+            auto dL = expected[0] - actual[0];
+            auto da = expected[1] - actual[1];
+            auto db = expected[2] - actual[2];
+            outOfGamut[i] = dL * dL + da * da + db * db > gamutTolerance * gamutTolerance;
+        }
+        lcmsStoreGamutMask(outOfGamut, first, count, mask, format);
+    }
+}
+
+
+void LCMSGamutChecker::convertRow(const void* fn_nonnull source, void* fn_nonnull destination, unsigned char* fn_nonnull mask, long width, LCMSGamutMaskFormat format, LCMSGamutScratch& scratch) const {
+    if (_fusedKernel) {
+        lcmsMatrixShaperTransformRow(*_fusedKernel, source, destination, width, mask, format);
+        return;
+    }
+    
+    if (_probeKernel) {
+        auto probeSource = source;
+        if (_widenInput) {
+            auto count = width * _numInputComponents;
+            scratch.source.resize(count);
+            auto bytes = static_cast<const unsigned char*>(source);
+            for (long i = 0; i < count; i++) {
+                scratch.source[i] = bytes[i] * (1.0f / 255);
+            }
+            probeSource = scratch.source.data();
+        }
+        lcmsMatrixShaperCheckGamutRow(*_probeKernel, probeSource, width, mask, format);
+    }
+    else {
+        _checkRoundTrip(source, mask, width, format, scratch);
+    }
+    
+    // Check first, the row may be converted in place
+    cmsDoTransform(_transform->get(), source, destination, static_cast<cmsUInt32Number>(width));
+}
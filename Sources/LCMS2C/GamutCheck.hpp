@@ -0,0 +1,100 @@
+//
+//  GamutCheck.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <LCMS2C/ConversionOptions.hpp>
+#include "TransformCache.hpp"
+#include <lcms2.h>
+#include <vector>
+#include <memory>
+
+
+class LCMSColorProfile;
+class LCMSContext;
+class MatrixShaperKernel;
+
+
+/// Scratch rows of a thread.
+struct LCMSGamutScratch {
+    std::vector<float> source;
+    std::vector<float> sourceLab;
+    std::vector<float> target;
+    std::vector<float> targetLab;
+};
+
+
+/// Converts rows of pixels and marks the source pixels the target profile can't reproduce.
+///
+/// Matrix-shaper targets are checked analytically: a colour is out of gamut exactly when one of its linear target values is outside `[0, 1]`. If the conversion itself takes the matrix-shaper fast path, the test is fused into its kernel, otherwise a float probe kernel of the same conversion runs before it.
+///
+/// Other targets are checked like lcms does it: a pixel is out of gamut if it moves by more than `gamutTolerance` ΔE after a round trip through the target's device values clamped to `[0, 1]`. Instead of painting alarm codes into the image the result goes to a separate mask.
+class LCMSGamutChecker final {
+private:
+    /// Transform of the conversion.
+    LCMSTransformReference _transform;
+    
+    /// Kernel that converts and checks in one pass.
+    const MatrixShaperKernel* fn_nullable _fusedKernel;
+    
+    /// Kernel that only checks, owned by the `_probe` transform.
+    LCMSTransformReference _probe;
+    const MatrixShaperKernel* fn_nullable _probeKernel;
+    
+    /// 8-bit pixels are widened to float for the probe kernel.
+    long _numInputComponents;
+    bool _widenInput;
+    
+    /// Round trip transforms of the generic check.
+    LCMSTransformReference _sourceToLab;
+    LCMSTransformReference _sourceToTarget;
+    LCMSTransformReference _targetToLab;
+    long _numTargetChannels;
+    
+    void _checkRoundTrip(const void* fn_nonnull source, unsigned char* fn_nonnull mask, long width, LCMSGamutMaskFormat format, LCMSGamutScratch& scratch) const;
+    
+public:
+    explicit LCMSGamutChecker(LCMSTransformReference transform);
+    
+    /// Builds or reuses the transforms that check pixels of the `inputFormat` against the `targetColorProfile` in the `context`. `transform` is the conversion, created with `flags` and `intent`.
+    static std::shared_ptr<LCMSGamutChecker> create(LCMSContext* fn_nonnull context, LCMSTransformReference transform,
+                                                    LCMSColorProfile* fn_nullable sourceColorProfile, LCMSColorProfile* fn_nullable targetColorProfile,
+                                                    cmsUInt32Number inputFormat, cmsUInt32Number intent, cmsUInt32Number flags);
+    
+    /// Sizes the `scratch` rows for rows of `width` pixels and returns their size in bytes.
+    long prepareScratch(long width, LCMSGamutScratch& scratch) const;
+    
+    /// Converts a row of `width` pixels and writes its mask. Out of gamut pixels are set.
+    ///
+    /// The mask is written before the row is converted, so `source` and `destination` may be the same.
+    void convertRow(const void* fn_nonnull source, void* fn_nonnull destination, unsigned char* fn_nonnull mask, long width, LCMSGamutMaskFormat format, LCMSGamutScratch& scratch) const;
+};
+
+
+
+/// Size of a mask row in bytes.
+static inline long lcmsGamutMaskBytesPerRow(long width, LCMSGamutMaskFormat format) {
+    return format == LCMSGamutMaskFormat::bit ? (width + 7) / 8 : width;
+}
+
+
+/// Writes `count` out of gamut flags, `0` or `1` per pixel, starting at pixel `first` of a mask row.
+static inline void lcmsStoreGamutMask(const unsigned char* fn_nonnull outOfGamut, long first, long count, unsigned char* fn_nonnull mask, LCMSGamutMaskFormat format) {
+    if (format == LCMSGamutMaskFormat::byte) {
+        for (long i = 0; i < count; i++) {
+            mask[first + i] = static_cast<unsigned char>(0 - outOfGamut[i]);
+        }
+        return;
+    }
+    
+    for (long i = 0; i < count; i++) {
+        auto x = first + i;
+        auto bit = static_cast<unsigned char>(0x80 >> (x % 8));
+        mask[x / 8] = outOfGamut[i] ? (mask[x / 8] | bit) : (mask[x / 8] & ~bit);
+    }
+}
@@ -0,0 +1,161 @@
+//
+//  Half.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "Half.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LCMS_HALF_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define LCMS_HALF_NEON 1
+#endif
+
+
+static void halfToFloatScalar(const LCMSHalf* fn_nonnull source, float* fn_nonnull destination, long count) {
+    for (long i = 0; i < count; i++) {
+        destination[i] = static_cast<float>(source[i]);
+    }
+}
+
+
+static void floatToHalfScalar(const float* fn_nonnull source, LCMSHalf* fn_nonnull destination, long count) {
+    for (long i = 0; i < count; i++) {
+        destination[i] = LCMSHalf(source[i]);
+    }
+}
+
+
+#if LCMS_HALF_X86
+
+__attribute__((target("avx2,f16c")))
+static void halfToFloatF16C(const LCMSHalf* fn_nonnull source, float* fn_nonnull destination, long count) {
+    long i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto halfs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        _mm256_storeu_ps(destination + i, _mm256_cvtph_ps(halfs));
+    }
+    for (; i + 4 <= count; i += 4) {
+        auto halfs = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i));
+        _mm_storeu_ps(destination + i, _mm_cvtph_ps(halfs));
+    }
+    for (; i < count; i++) {
+        destination[i] = _cvtsh_ss(source[i].bits);
+    }
+}
+
+
+__attribute__((target("avx2,f16c")))
+static void floatToHalfF16C(const float* fn_nonnull source, LCMSHalf* fn_nonnull destination, long count) {
+    long i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto halfs = _mm256_cvtps_ph(_mm256_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), halfs);
+    }
+    for (; i + 4 <= count; i += 4) {
+        auto halfs = _mm_cvtps_ph(_mm_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(destination + i), halfs);
+    }
+    for (; i < count; i++) {
+        destination[i].bits = _cvtss_sh(source[i], _MM_FROUND_TO_NEAREST_INT);
+    }
+}
+
+
+__attribute__((target("avx512f,avx2,f16c")))
+static void halfToFloatAVX512(const LCMSHalf* fn_nonnull source, float* fn_nonnull destination, long count) {
+    long i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto halfs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+        _mm512_storeu_ps(destination + i, _mm512_cvtph_ps(halfs));
+    }
+    halfToFloatF16C(source + i, destination + i, count - i);
+}
+
+
+__attribute__((target("avx512f,avx2,f16c")))
+static void floatToHalfAVX512(const float* fn_nonnull source, LCMSHalf* fn_nonnull destination, long count) {
+    long i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto halfs = _mm512_cvtps_ph(_mm512_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), halfs);
+    }
+    floatToHalfF16C(source + i, destination + i, count - i);
+}
+
+#endif
+
+
+#if LCMS_HALF_NEON
+
+static void halfToFloatNEON(const LCMSHalf* fn_nonnull source, float* fn_nonnull destination, long count) {
+    long i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto halfs = vreinterpretq_f16_u16(vld1q_u16(&source[i].bits));
+        vst1q_f32(destination + i, vcvt_f32_f16(vget_low_f16(halfs)));
+        vst1q_f32(destination + i + 4, vcvt_high_f32_f16(halfs));
+    }
+    for (; i + 4 <= count; i += 4) {
+        auto halfs = vreinterpret_f16_u16(vld1_u16(&source[i].bits));
+        vst1q_f32(destination + i, vcvt_f32_f16(halfs));
+    }
+    halfToFloatScalar(source + i, destination + i, count - i);
+}
+
+
+static void floatToHalfNEON(const float* fn_nonnull source, LCMSHalf* fn_nonnull destination, long count) {
+    long i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto low = vcvt_f16_f32(vld1q_f32(source + i));
+        auto halfs = vcvt_high_f16_f32(low, vld1q_f32(source + i + 4));
+        vst1q_u16(&destination[i].bits, vreinterpretq_u16_f16(halfs));
+    }
+    for (; i + 4 <= count; i += 4) {
+        auto halfs = vcvt_f16_f32(vld1q_f32(source + i));
+        vst1_u16(&destination[i].bits, vreinterpret_u16_f16(halfs));
+    }
+    floatToHalfScalar(source + i, destination + i, count - i);
+}
+
+#endif
+
+
+/// Conversion kernels for the current CPU.
+struct HalfKernels {
+    void (* fn_nonnull halfToFloat)(const LCMSHalf* fn_nonnull source, float* fn_nonnull destination, long count);
+    void (* fn_nonnull floatToHalf)(const float* fn_nonnull source, LCMSHalf* fn_nonnull destination, long count);
+    
+    static const HalfKernels& current() {
+        static const HalfKernels kernels = []() -> HalfKernels {
+#if LCMS_HALF_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                return { halfToFloatAVX512, floatToHalfAVX512 };
+            }
+            // Every CPU with AVX2 has F16C
+            if (__builtin_cpu_supports("avx2")) {
+                return { halfToFloatF16C, floatToHalfF16C };
+            }
+#elif LCMS_HALF_NEON
+            // Every 64-bit ARM CPU has NEON half float conversions
+            return { halfToFloatNEON, floatToHalfNEON };
+#endif
+            return { halfToFloatScalar, floatToHalfScalar };
+        }();
+        return kernels;
+    }
+};
+
+
+void lcmsHalfToFloat(const LCMSHalf* fn_nonnull source, float* fn_nonnull destination, long count) {
+    HalfKernels::current().halfToFloat(source, destination, count);
+}
+
+
+void lcmsFloatToHalf(const float* fn_nonnull source, LCMSHalf* fn_nonnull destination, long count) {
+    HalfKernels::current().floatToHalf(source, destination, count);
+}
@@ -0,0 +1,95 @@
+//
+//  Half.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <cstdint>
+#include <cstring>
+
+
+/// Bits of a float converted to the closest half float, rounding to nearest even.
+static inline uint16_t lcmsFloatToHalfBits(float value) {
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+    
+    uint16_t half = 0;
+    if (bits >= 0x47800000u) {
+        // Too large for half, infinity or NaN
+        half = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+    }
+    else if (bits < 0x38800000u) {
+        // Subnormal half or zero, let the float addition do the rounding
+        constexpr uint32_t magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+        float magic = 0;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        
+        float aligned = 0;
+        memcpy(&aligned, &bits, sizeof(aligned));
+        aligned += magic;
+        memcpy(&bits, &aligned, sizeof(bits));
+        half = static_cast<uint16_t>(bits - magicBits);
+    }
+    else {
+        // Rebias the exponent and round the dropped mantissa bits
+        uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + mantissaOdd;
+        half = static_cast<uint16_t>(bits >> 13);
+    }
+    
+    return half | static_cast<uint16_t>(sign >> 16);
+}
+
+
+/// Float value of the half float `bits`. Every half is exactly representable as float.
+static inline float lcmsHalfBitsToFloat(uint16_t bits) {
+    uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+    uint32_t exponent = (bits >> 10) & 0x1f;
+    uint32_t mantissa = bits & 0x3ff;
+    
+    float value = 0;
+    if (exponent == 0) {
+        // Zero or subnormal: mantissa * 2^-24
+        value = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+    
+    uint32_t result = exponent == 0x1f ?
+    sign | 0x7f800000u | (mantissa << 13) :
+    sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    memcpy(&value, &result, sizeof(value));
+    return value;
+}
+
+
+/// IEEE 754 half precision float.
+///
+/// Portable stand-in for `__fp16`, which only ARM toolchains provide. It's only a storage type, do the math in float.
+struct LCMSHalf {
+    uint16_t bits;
+    
+    LCMSHalf() = default;
+    explicit LCMSHalf(float value): bits(lcmsFloatToHalfBits(value)) { }
+    explicit operator float() const { return lcmsHalfBitsToFloat(bits); }
+};
+
+static_assert(sizeof(LCMSHalf) == 2, "LCMSHalf has to have the same layout as a half float");
+
+
+/// Widens `count` half floats to floats.
+///
+/// Uses the widest vector instructions the CPU supports: AVX-512 or F16C on x86, NEON on ARM.
+void lcmsHalfToFloat(const LCMSHalf* fn_nonnull source, float* fn_nonnull destination, long count);
+
+
+/// Narrows `count` floats to half floats, rounding to nearest even.
+///
+/// Uses the widest vector instructions the CPU supports: AVX-512 or F16C on x86, NEON on ARM.
+void lcmsFloatToHalf(const float* fn_nonnull source, LCMSHalf* fn_nonnull destination, long count);
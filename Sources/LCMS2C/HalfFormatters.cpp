@@ -0,0 +1,80 @@
+//
+//  HalfFormatters.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "HalfFormatters.hpp"
+#include "Half.hpp"
+#include <lcms2_plugin.h>
+#include <cstring>
+
+
+/// Reads the colour channels of a pixel with `numChannels` colour and `numExtra` extra half floats. Extra channels are copied by lcms separately.
+template <int numChannels, int numExtra>
+static cmsUInt8Number* unrollHalf(struct _cmstransform_struct* CMMcargo,
+                                  cmsFloat32Number Values[],
+                                  cmsUInt8Number* Buffer,
+                                  cmsUInt32Number Stride) {
+    // lcms asks for one pixel at a time, too few values for the vector kernels to pay off. The loop is unrolled at compile time
+    for (int i = 0; i < numChannels + numExtra; i++) {
+        uint16_t bits;
+        std::memcpy(&bits, Buffer + i * sizeof(LCMSHalf), sizeof(bits));
+        Values[i] = lcmsHalfBitsToFloat(bits);
+    }
+    return Buffer + (numChannels + numExtra) * sizeof(LCMSHalf);
+}
+
+
+/// Writes the colour channels of a pixel with `numChannels` colour and `numExtra` extra half floats, and leaves the extra channels untouched.
+template <int numChannels, int numExtra>
+static cmsUInt8Number* packHalf(struct _cmstransform_struct* CMMcargo,
+                                cmsFloat32Number Values[],
+                                cmsUInt8Number* Buffer,
+                                cmsUInt32Number Stride) {
+    for (int i = 0; i < numChannels; i++) {
+        auto bits = lcmsFloatToHalfBits(Values[i]);
+        std::memcpy(Buffer + i * sizeof(LCMSHalf), &bits, sizeof(bits));
+    }
+    return Buffer + (numChannels + numExtra) * sizeof(LCMSHalf);
+}
+
+
+template <int numChannels, int numExtra>
+static cmsFormatter halfFormatter(cmsFormatterDirection Dir) {
+    cmsFormatter formatter;
+    formatter.FmtFloat = Dir == cmsFormatterInput ? unrollHalf<numChannels, numExtra> : packHalf<numChannels, numExtra>;
+    return formatter;
+}
+
+
+static cmsFormatter halfFormattersFactory(cmsUInt32Number Type, cmsFormatterDirection Dir, cmsUInt32Number dwFlags) {
+    // Everything else is handled by the built-in formatters
+    if ((dwFlags & CMS_PACK_FLAGS_FLOAT) == 0) {
+        return { .Fmt16 = nullptr };
+    }
+    
+    switch (Type) {
+        case TYPE_GRAY_HALF_FLT: return halfFormatter<1, 0>(Dir);
+        case TYPE_GRAYA_HALF_FLT: return halfFormatter<1, 1>(Dir);
+        case TYPE_RGB_HALF_FLT: return halfFormatter<3, 0>(Dir);
+        case TYPE_RGBA_HALF_FLT: return halfFormatter<3, 1>(Dir);
+        default: return { .Fmt16 = nullptr };
+    }
+}
+
+
+bool lcmsInstallHalfFormatters(cmsContext fn_nonnull context) {
+    static cmsPluginFormatters plugin = {
+        .base = {
+            .Magic = cmsPluginMagicNumber,
+            .ExpectedVersion = LCMS_VERSION,
+            .Type = cmsPluginFormattersSig,
+            .Next = nullptr
+        },
+        .FormattersFactory = halfFormattersFactory
+    };
+    
+    return cmsPluginTHR(context, &plugin);
+}
@@ -0,0 +1,19 @@
+//
+//  HalfFormatters.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <lcms2.h>
+
+
+/// Interleaved gray and alpha half floats. lcms has no predefined type for it.
+#define TYPE_GRAYA_HALF_FLT (FLOAT_SH(1)|COLORSPACE_SH(PT_GRAY)|EXTRA_SH(1)|CHANNELS_SH(1)|BYTES_SH(2))
+
+
+/// Installs lcms formatters that read and write the wrapper's interleaved half float pixel formats, including `TYPE_GRAYA_HALF_FLT`, into the `context`.
+bool lcmsInstallHalfFormatters(cmsContext fn_nonnull context);
@@ -8,6 +8,41 @@
 #pragma once
 
 #include <LCMS2C/Common.hpp>
+#include <LCMS2C/ConversionOptions.hpp>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+
+
+struct _cmsContext_struct;
+class LCMSContext;
+class LCMSMemoryTracker;
+struct LCMSProfileMetadata;
+
+
+/// Called when a colour profile no longer needs the ICC data it borrowed.
+using LCMSProfileDataRelease = void (*)(void* fn_nullable userData, const void* fn_nonnull data, long size);
+
+
+class LCMSColorProfile;
+
+
+/// Receives a colour profile loaded by ``LCMSColorProfile/loadDirectory``. Retain the `profile` to keep it.
+using LCMSProfileDirectoryHandler = void (*)(void* fn_nullable userData, const char* fn_nonnull path, LCMSColorProfile* fn_nonnull profile);
+
+
+/// 16-byte fingerprint of an ICC profile.
+///
+/// It's the profile ID of the ICC header if it's set, otherwise the MD5 of the profile computed the same way, with the header's flags, rendering intent and profile ID zeroed. Profiles with the same contents get the same fingerprint whether their writer stored the ID or not.
+struct LCMSProfileID {
+    uint64_t high;
+    uint64_t low;
+    
+    bool operator==(const LCMSProfileID& other) const = default;
+    
+    /// Fingerprint of raw ICC profile data.
+    static LCMSProfileID compute(const void* fn_nonnull data fn_noescape, long size);
+};
 
 
 /// Colour profile.
@@ -17,46 +52,149 @@
 /// - Seealso: [International Color Consortium](https://www.color.org/index.xalter)
 class LCMSColorProfile final {
 private:
-    char _name[512];
-    
     std::atomic<size_t> _referenceCounter;
     const char* fn_nonnull _data;
     long _size;
     
-    LCMSColorProfile(const char* fn_nonnull data, long size);
+    /// The data belongs to the caller and is handed back with `_releaseData` if it's set.
+    bool _borrowingData;
+    LCMSProfileDataRelease fn_nullable _releaseData;
+    void* fn_nullable _releaseUserData;
+    
+    /// Computed on first use.
+    std::once_flag _profileIDOnce;
+    LCMSProfileID _profileID;
+    
+    /// Listed in the profile table of the parent context.
+    bool _interned;
+    
+    /// Built-in profile of the default context. Lives as long as the process and isn't reference counted.
+    bool _immortal;
+    
+    /// Context the profile was created in. The profile is parsed in its own lcms context created by it.
+    LCMSContext* fn_nonnull _parentContext;
+    
+    /// Tracker the profile data is counted in.
+    LCMSMemoryTracker* fn_nonnull _memoryTracker;
+    
+    /// Parsed profile, opened on first use.
+    ///
+    /// Cached transforms may keep memory allocated in the profile's lcms context, so they share it.
+    std::once_flag _profileOnce;
+    std::shared_ptr<_cmsContext_struct> _context;
+    void* fn_nullable _profile;
+    
+    /// Description, read from the parsed profile on first use.
+    std::once_flag _metadataOnce;
+    std::unique_ptr<LCMSProfileMetadata> _metadata;
+    
+    LCMSColorProfile(const char* fn_nonnull data, long size, bool borrowingData, LCMSProfileDataRelease fn_nullable releaseData, void* fn_nullable releaseUserData, LCMSContext* fn_nonnull context);
     ~LCMSColorProfile();
     
+    const LCMSProfileMetadata& _getMetadata();
+    
+    /// Turns a new `profile` into a built-in one that is never freed, with its handle and fingerprint ready.
+    static LCMSColorProfile* fn_nonnull _makeImmortal(LCMSColorProfile* fn_nonnull profile);
+    
     friend LCMSColorProfile* fn_nullable LCMSColorProfileRetain(LCMSColorProfile* fn_nullable value) SWIFT_RETURNS_UNRETAINED;
     friend void LCMSColorProfileRelease(LCMSColorProfile* fn_nullable value);
+    friend class LCMSCachedTransform;
+    friend class LCMSProfileTable;
     
 public:
-    static LCMSColorProfile* fn_nonnull create(const void* fn_nonnull data fn_noescape, long size) SWIFT_RETURNS_RETAINED;
+    /// Creates a colour profile from ICC data in the `context`, or in the default context if it's not specified.
+    static LCMSColorProfile* fn_nonnull create(const void* fn_nonnull data fn_noescape, long size, LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates a colour profile that borrows the ICC `data` instead of copying it, for example from a memory-mapped file.
+    ///
+    /// When the profile is destroyed, `releaseData` is called with the `userData`, the `data` and the `size`, if it's specified. Borrowed data isn't counted in the context's memory report.
+    ///
+    /// - Warning: The `data` has to stay available and unchanged until it's released.
+    static LCMSColorProfile* fn_nonnull createBorrowing(const void* fn_nonnull data, long size, LCMSProfileDataRelease fn_nullable releaseData = nullptr, void* fn_nullable userData = nullptr, LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates a colour profile from ICC `data` with static storage duration, such as a constant array. Nothing is copied or released.
+    static LCMSColorProfile* fn_nonnull createStatic(const void* fn_nonnull data, long size, LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates a colour profile from an ICC file without reading it into memory.
+    ///
+    /// The file is mapped read-only for the lifetime of the profile, so only the parts lcms reads become resident. Returns `nullptr` if the file can't be opened, isn't a regular file or is too small to be a profile.
+    ///
+    /// - Warning: Don't modify or truncate the file while the profile is alive.
+    static LCMSColorProfile* fn_nullable createFromFile(const char* fn_nonnull path, LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates colour profiles from the `.icc` and `.icm` files of a directory with ``createFromFile`` and passes each to the `handler`, in no particular order.
+    ///
+    /// Returns the number of loaded profiles, or `-1` if the directory can't be read.
+    static long loadDirectory(const char* fn_nonnull path, LCMSProfileDirectoryHandler fn_nonnull handler, void* fn_nullable userData = nullptr, LCMSContext* fn_nullable context = nullptr);
+    
+    /// Returns the colour profile of the `context` with the same ICC data, or creates one if there's none.
+    ///
+    /// Images that embed the same profile share a single object, so caches keyed on profiles hit and the data is kept once. Interned profiles are released like any other, the context only keeps track of the live ones. In the default context the bytes of a built-in profile return that built-in profile.
+    static LCMSColorProfile* fn_nonnull createInterned(const void* fn_nonnull data fn_noescape, long size, LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
     
     /// sRGB color profile.
     ///
+    /// Built-in profiles of the default context are created once and shared by all callers, asking for them again doesn't allocate. Other contexts share theirs as interned profiles.
+    ///
     /// - Seealso: [sRGB profiles](https://www.color.org/srgbprofiles.xalter)
-    static LCMSColorProfile* fn_nonnull createSRGB() SWIFT_RETURNS_RETAINED;
+    static LCMSColorProfile* fn_nonnull createSRGB(LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
     
     /// Rec. 709 Reference Display - the ITU-R Recommendation 709 standard.
     ///
     /// - Seealso: [Rec. 709 Reference Display](https://www.color.org/rec709.xalter)
-    static LCMSColorProfile* fn_nonnull createRec709() SWIFT_RETURNS_RETAINED;
+    static LCMSColorProfile* fn_nonnull createRec709(LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
     
     /// Rec. 2020 or BT.2020
     ///
     /// - Seealso: [BT.2020](https://www.color.org/chardata/rgb/BT2020.xalter)
-    static LCMSColorProfile* fn_nonnull createRec2020() SWIFT_RETURNS_RETAINED;
+    static LCMSColorProfile* fn_nonnull createRec2020(LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
     
-    static LCMSColorProfile* fn_nonnull createDCIP3() SWIFT_RETURNS_RETAINED;
-    static LCMSColorProfile* fn_nonnull createDCIP3D65() SWIFT_RETURNS_RETAINED;
+    static LCMSColorProfile* fn_nonnull createDCIP3(LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
+    static LCMSColorProfile* fn_nonnull createDCIP3D65(LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
     
     LCMSColorProfile* fn_nullable createLinear(bool force = true) SWIFT_RETURNS_RETAINED SWIFT_NAME(createLinear(force:));
     
-    const char* fn_nonnull getName() fn_lifetimebound SWIFT_NAME(__getNameUnsafe()) { return _name; }
+    /// Profile description in UTF-8, or an empty string if the profile has none.
+    const char* fn_nonnull getName() fn_lifetimebound SWIFT_NAME(__getNameUnsafe());
+    
+    /// Checks the ICC header and tag table without parsing the profile. Invalid profiles are never opened with lcms.
+    bool checkIsValid();
+    
+    /// ICC signature of the data colour space, for example `'RGB '`.
+    ///
+    /// Header fields are read in place on every call without parsing the profile. They're `0` if the profile is invalid.
+    uint32_t getColorSpaceSignature() SWIFT_COMPUTED_PROPERTY;
+    
+    /// ICC signature of the device class, for example `'mntr'`.
+    uint32_t getDeviceClassSignature() SWIFT_COMPUTED_PROPERTY;
+    
+    /// ICC signature of the profile connection space, `'XYZ '` or `'Lab '`.
+    uint32_t getPCSSignature() SWIFT_COMPUTED_PROPERTY;
+    
+    /// ICC version of the profile, for example `4.3`.
+    double getVersion() SWIFT_COMPUTED_PROPERTY;
+    
+    /// Rendering intent stored in the profile header.
+    LCMSRenderingIntent getRenderingIntent() SWIFT_COMPUTED_PROPERTY;
+    
+    /// Checks the tag table for a tag, for example `'A2B0'`, without parsing the profile.
+    bool hasTag(uint32_t signature);
+    
+    LCMSContext* fn_nonnull getContext() SWIFT_COMPUTED_PROPERTY SWIFT_RETURNS_UNRETAINED { return _parentContext; }
     
     const char* fn_nonnull getData() fn_lifetimebound SWIFT_COMPUTED_PROPERTY { return _data; }
     long getSize() SWIFT_COMPUTED_PROPERTY { return _size; }
     
+    /// Fingerprint of the profile, computed once. Profiles with equal fingerprints are interchangeable.
+    LCMSProfileID getProfileID() SWIFT_COMPUTED_PROPERTY;
+    
+    /// Parsed lcms profile (`cmsHPROFILE`) owned by this colour profile.
+    ///
+    /// The profile is parsed once on first access in its own lcms context and stays alive as long as this object. Returns `nullptr` if the data is not a valid ICC profile.
+    ///
+    /// - Warning: Don't close the returned handle.
+    void* fn_nullable getHandle() fn_lifetimebound SWIFT_NAME(__getHandleUnsafe());
+    
     bool checkIsLinear();
     bool checkIsSRGB();
 }
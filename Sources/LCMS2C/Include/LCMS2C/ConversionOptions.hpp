@@ -0,0 +1,107 @@
+//
+//  ConversionOptions.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+
+
+/// ICC rendering intent. Values match lcms's `INTENT_*` constants.
+enum class LCMSRenderingIntent: long {
+    perceptual = 0,
+    relativeColorimetric = 1,
+    saturation = 2,
+    absoluteColorimetric = 3
+};
+
+
+/// How much lcms may precalculate the transform pipeline.
+enum class LCMSPrecalculation: long {
+    /// Picks the plan from the number of pixels, the pixel formats and the kinds of profiles, weighing the cost of building a lookup table against the cost of evaluating every pixel.
+    automatic = 0,
+    
+    /// Every pipeline is evaluated stage by stage, the reference result.
+    none,
+    
+    /// Integer pipelines are resampled into a small lookup table.
+    low,
+    
+    /// lcms's default optimisations.
+    normal,
+    
+    /// Integer pipelines are resampled into a large lookup table.
+    high
+};
+
+
+/// Precalculation strategy a transform was built with.
+enum class LCMSConversionPlan: long {
+    /// The pipeline is evaluated stage by stage.
+    exact = 0,
+    
+    /// Small lookup table, cheap to build.
+    lowResolution,
+    
+    /// lcms's default optimisations. Float pipelines are only simplified losslessly and may take the matrix-shaper fast path.
+    normal,
+    
+    /// Large lookup table, the most accurate precalculation.
+    highResolution,
+    
+    /// Source and target profiles are equivalent, pixels are only repacked into the output format. Nothing is done at all if the formats are the same too.
+    formatOnly
+};
+
+
+/// Layout of a gamut mask row.
+enum class LCMSGamutMaskFormat: long {
+    /// One bit per pixel, most significant bit first. Rows start at a byte boundary.
+    bit = 0,
+    
+    /// One byte per pixel, `255` for out of gamut pixels and `0` otherwise.
+    byte
+};
+
+
+/// Parameters of a colour conversion.
+///
+/// Default values are the ``balanced()`` tier. Use ``exact()`` or ``fast()`` for the other named speed/quality tiers.
+///
+/// - Note: Before conversion options existed, every conversion was evaluated stage by stage. The defaults don't reproduce that output: float and half float conversions are simplified by lcms and may take the matrix-shaper fast path, which is within 2^-9 of the stage by stage result, and integer conversions may go through a lookup table. Use ``exact()`` for the previous output.
+struct LCMSConversionOptions {
+    LCMSRenderingIntent intent = LCMSRenderingIntent::absoluteColorimetric;
+    
+    bool blackPointCompensation = false;
+    
+    /// Fills a gamut mask of the source pixels the target profile can't reproduce, in the same pass as the conversion. Only used by calls that take a mask buffer, the converted pixels are never altered.
+    bool gamutCheck = false;
+    
+    LCMSGamutMaskFormat gamutMaskFormat = LCMSGamutMaskFormat::byte;
+    
+    /// Keeps pure white white in integer pipelines at the cost of a slower transform.
+    bool whiteOnWhiteFixup = false;
+    
+    /// Clamps negative values of float transforms.
+    ///
+    /// lcms only takes its fixed point path for 8-bit matrix-shaper transforms without it, with it they need a lookup table that is much more expensive to build.
+    bool clipNegatives = true;
+    
+    /// Unlike the stage by stage evaluation of earlier versions, ``LCMSPrecalculation/automatic`` lets lcms optimise the transform when that pays off, so results may differ slightly from theirs.
+    LCMSPrecalculation precalculation = LCMSPrecalculation::automatic;
+    
+    /// Number of grid points per dimension of the precalculated lookup table, `2...255`. `0` lets lcms decide based on `precalculation`.
+    long gridPoints = 0;
+    
+    /// Reference path: every transform is evaluated stage by stage.
+    static LCMSConversionOptions exact();
+    
+    /// Lets the planner pick the precalculation. Same as the default values.
+    static LCMSConversionOptions balanced();
+    
+    /// Lets lcms optimise every transform, including lossy lookup tables for integer pixels.
+    static LCMSConversionOptions fast();
+};
@@ -11,6 +11,10 @@
 
 #include <LCMS2C/Common.hpp>
 #include <LCMS2C/ColorProfile.hpp>
+#include <LCMS2C/ConversionOptions.hpp>
+#include <LCMS2C/LCMSContext.hpp>
 #include <LCMS2C/LCMSImage.hpp>
+#include <LCMS2C/LCMSTransform.hpp>
+#include <LCMS2C/MemoryReport.hpp>
 
 #endif
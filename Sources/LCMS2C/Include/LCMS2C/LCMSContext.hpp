@@ -0,0 +1,175 @@
+//
+//  LCMSContext.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <LCMS2C/MemoryReport.hpp>
+#include <mutex>
+#include <memory>
+
+
+struct _cmsContext_struct;
+class LCMSTransformCache;
+class LCMSProfilePairCache;
+class LCMSProfileTable;
+class LCMSMemoryTracker;
+
+
+/// Allocator lcms uses for the profiles, pipelines and transforms of a context.
+enum class LCMSAllocator: long {
+    /// Size-class pools shared by all pooled contexts. Parsing and releasing lots of small profiles and transforms doesn't hit the system allocator.
+    pooled = 0,
+    
+    /// `malloc` and `free`, for comparison.
+    system
+};
+
+
+/// Receives lcms error messages of a context.
+///
+/// Called on the thread that hit the error, possibly from several threads at the same time.
+using LCMSLogHandler = void (*)(void* fn_nullable userData, long errorCode, const char* fn_nonnull message);
+
+
+/// Isolated lcms environment: plugins, alarm codes, adaptation state, error log and transform cache.
+///
+/// Colour profiles, images and transforms are created in a context. Everything created without one uses the ``getDefault()`` context, so configuring a separate context never affects other users of the library.
+///
+/// - Note: A context can be used from multiple threads at the same time.
+class LCMSContext final {
+private:
+    std::atomic<size_t> _referenceCounter;
+    
+    _cmsContext_struct* fn_nullable _context;
+    LCMSAllocator _allocator;
+    
+    /// Copies of `_context` that transforms are created in, created on first use. Threads are spread over them, so that concurrent transform creation doesn't contend on a single lcms context.
+    long _numShards;
+    std::unique_ptr<std::atomic<_cmsContext_struct*>[]> _shards;
+    
+    /// Guards creation of shards and changes of the settings they copy.
+    std::mutex _settingsMutex;
+    
+    std::unique_ptr<LCMSTransformCache> _transformCache;
+    std::unique_ptr<LCMSProfilePairCache> _profilePairCache;
+    std::unique_ptr<LCMSProfileTable> _profileTable;
+    std::atomic<long> _maxWorkers;
+    LCMSMemoryTracker* fn_nonnull _memoryTracker;
+    
+    /// Guards the log handler.
+    std::mutex _logMutex;
+    LCMSLogHandler fn_nullable _logHandler;
+    void* fn_nullable _logUserData;
+    
+    LCMSContext(LCMSAllocator allocator, long numShards);
+    ~LCMSContext();
+    
+    /// Creates an lcms context with the allocator, plugins and log handler of this context and the settings of `_context`, if it exists. Call it with `_settingsMutex` locked once `_context` exists.
+    _cmsContext_struct* fn_nullable _createHandle(void* fn_nullable owner);
+    
+    /// Calls `body` for the main lcms context and every shard created so far.
+    template<typename Body>
+    void _forEachHandle(Body body) {
+        body(_context);
+        for (long i = 0; i < _numShards; i++) {
+            if (auto shard = _shards[i].load()) {
+                body(shard);
+            }
+        }
+    }
+    static void _logError(_cmsContext_struct* fn_nullable context, unsigned int errorCode, const char* fn_nullable message);
+    
+    FN_FRIEND_SWIFT_INTERFACE(LCMSContext)
+    
+public:
+    /// Creates a context with the wrapper's plugins installed: the transform scheduler, the half float formatters and the matrix-shaper fast path.
+    ///
+    /// The `allocator` can't be changed later. Use ``LCMSAllocator/system`` to compare against the pools.
+    ///
+    /// Threads create transforms in up to `numShards` copies of the lcms context, `0` means one per core, up to 64. With `1` every thread shares a single copy.
+    static LCMSContext* fn_nullable create(LCMSAllocator allocator = LCMSAllocator::pooled, long numShards = 0) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates a copy of the context with the same allocator, number of shards, plugins, alarm codes, adaptation state, log handler and thread limit, but an empty transform cache.
+    LCMSContext* fn_nullable duplicate() SWIFT_RETURNS_RETAINED;
+    
+    /// Context used by everything created without a context. Lives as long as the process.
+    static LCMSContext* fn_nonnull getDefault() SWIFT_RETURNS_UNRETAINED;
+    
+    LCMSAllocator getAllocator() const SWIFT_COMPUTED_PROPERTY { return _allocator; }
+    
+    /// Sets the receiver of the context's error messages. Pass `nullptr` to print them to the standard output.
+    void setLogHandler(LCMSLogHandler fn_nullable handler, void* fn_nullable userData);
+    
+    /// Sets the colour that gamut checked lcms transforms paint out of gamut pixels with, one 16-bit value per channel.
+    ///
+    /// Applies to transforms created afterwards, so the context's transform cache is cleared.
+    void setAlarmCode(long channel, unsigned short value);
+    unsigned short getAlarmCode(long channel);
+    
+    /// Sets how much absolute colorimetric transforms adapt to the white point of the source, `0...1`.
+    ///
+    /// Applies to transforms created afterwards, so the context's transform cache is cleared.
+    void setAdaptationState(double adaptationState);
+    double getAdaptationState() SWIFT_COMPUTED_PROPERTY;
+    
+    /// Sets the maximum number of threads a single transform call may use when no thread count is passed to it. `0` means one thread per core.
+    ///
+    /// Can be changed at any time, calls that are already running keep their threads.
+    void setMaxWorkers(long maxWorkers);
+    long getMaxWorkers() const SWIFT_COMPUTED_PROPERTY { return _maxWorkers; }
+    
+    /// Drops all cached transforms. Transforms still in use stay alive until released.
+    void clearTransformCache();
+    
+    /// Memory used by the context's images, profiles, transforms and conversions, and the peak since creation or the last ``resetPeakMemoryUsage()``.
+    ///
+    /// lcms allocations are counted in the context that asked for them, temporary profiles and transforms included. Borrowed pixel and profile data isn't counted.
+    LCMSMemoryReport getMemoryReport() const SWIFT_COMPUTED_PROPERTY;
+    void resetPeakMemoryUsage();
+    
+    /// Memory used by the last conversion that finished on the calling thread, in any context.
+    ///
+    /// Counts everything the conversion allocated, including transforms it created and images it returned. `current` is what the conversion still held when it finished, `peak` the most it held at once.
+    static LCMSMemoryReport getLastConversionMemoryReport();
+    
+    /// Underlying lcms context (`cmsContext`). Profiles are parsed in copies of it.
+    _cmsContext_struct* fn_nonnull getHandle() SWIFT_NAME(__getHandleUnsafe()) { return _context; }
+    
+    /// Copy of the underlying lcms context assigned to the calling thread, for creating transforms.
+    ///
+    /// It has the same plugins and settings and belongs to this context just like the main one.
+    _cmsContext_struct* fn_nonnull getThreadHandle() SWIFT_NAME(__getThreadHandleUnsafe());
+    
+    /// Creates an lcms context to parse a profile in, with the same plugins and settings. The caller deletes it with `cmsDeleteContext`.
+    ///
+    /// It doesn't point back to this context, because transforms cached in other contexts may keep it alive longer. Its errors reach this context's log handler only while an `LCMSLogScope` of this context is open on the thread.
+    _cmsContext_struct* fn_nullable createProfileHandle() SWIFT_NAME(__createProfileHandleUnsafe());
+    
+    /// Transforms created in the context, shared between all of its users.
+    LCMSTransformCache& getTransformCache() SWIFT_NAME(__getTransformCacheUnsafe()) { return *_transformCache; }
+    
+    /// What transform creation learned about the profile pairs of the context, so that it doesn't inspect them again.
+    LCMSProfilePairCache& getProfilePairCache() SWIFT_NAME(__getProfilePairCacheUnsafe()) { return *_profilePairCache; }
+    
+    /// Live interned colour profiles of the context.
+    LCMSProfileTable& getProfileTable() SWIFT_NAME(__getProfileTableUnsafe()) { return *_profileTable; }
+    
+    /// Tracker the context's memory is counted in.
+    LCMSMemoryTracker* fn_nonnull getMemoryTracker() SWIFT_NAME(__getMemoryTrackerUnsafe()) { return _memoryTracker; }
+}
+FN_SWIFT_INTERFACE(LCMSContext)
+SWIFT_UNCHECKED_SENDABLE;
+
+
+FN_DEFINE_SWIFT_INTERFACE(LCMSContext)
+
+
+/// Returns the `context`, or the default context if it's not specified.
+static inline LCMSContext* fn_nonnull lcmsContextOrDefault(LCMSContext* fn_nullable context) {
+    return context ? context : LCMSContext::getDefault();
+}
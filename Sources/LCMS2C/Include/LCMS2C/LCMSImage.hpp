@@ -8,9 +8,12 @@
 #pragma once
 
 #include <LCMS2C/Common.hpp>
+#include <LCMS2C/ConversionOptions.hpp>
 
 
 class LCMSColorProfile;
+class LCMSContext;
+class LCMSMemoryTracker;
 
 
 enum class LCMSPixelComponentType: long {
@@ -38,22 +41,45 @@ private:
     /// If no color profile is specified, it's assumed to be `sRGB`.
     LCMSColorProfile* fn_nullable _colorProfile;
     
+    /// Context the image's conversions run in.
+    LCMSContext* fn_nonnull _context;
+    
+    /// Tracker owned pixel data is counted in.
+    LCMSMemoryTracker* fn_nullable _memoryTracker;
+    
     friend LCMSImage* fn_nullable LCMSImageRetain(LCMSImage* fn_nullable container) SWIFT_RETURNS_UNRETAINED;
     friend void LCMSImageRelease(LCMSImage* fn_nullable container);
+    friend class LCMSTransform;
+    friend LCMSImage* fn_nullable convertToLinearDCIP3(const char* fn_nonnull sourceData, long width, long height, long numComponents, long componentSize, bool isHDR, const char* fn_nullable iccpData, long iccpLength, const LCMSConversionOptions& options, LCMSContext* fn_nullable context);
     
-    LCMSImage(char* fn_nonnull data, bool borrowingData, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile);
+    LCMSImage(char* fn_nonnull data, bool borrowingData, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile, LCMSContext* fn_nonnull context);
     ~LCMSImage();
     
 public:
-    static LCMSImage* fn_nullable create(const char* fn_nonnull data, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile = nullptr) SWIFT_RETURNS_RETAINED;
+    /// Creates an image with a copy of the `data`.
+    ///
+    /// Conversions of the image run in the `context`, or in the default context if it's not specified.
+    static LCMSImage* fn_nullable create(const char* fn_nonnull data, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile = nullptr, LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
     
     /// Create an image by borrowing image contents to avoid data copy.
     ///
     /// - Warning: Since `data` is being borrowed, make sure that it is abailable for the whole `LCMSImage`'s lifecycle and not changed concurrently. Otherwise use the regular `create` method that copies the data.
-    static LCMSImage* fn_nullable createBorrowing(char* fn_nonnull data, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile = nullptr) SWIFT_RETURNS_RETAINED;
+    static LCMSImage* fn_nullable createBorrowing(char* fn_nonnull data, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile = nullptr, LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
     
     /// If no target color profile is specified, it's assumed to be `sRGB`.
-    bool convertColorProfile(LCMSColorProfile* fn_nullable targetColorProfile);
+    ///
+    /// Large images are converted in slices on up to `numThreads` threads. Pass `0` to use the context's `maxWorkers` limit, or `1` to stay on the calling thread. The result is the same for any number of threads.
+    bool convertColorProfile(LCMSColorProfile* fn_nullable targetColorProfile, long numThreads = 0);
+    
+    /// Converts the image with the conversion `options`.
+    ///
+    /// If `plan` is specified, it receives the precalculation strategy that was used, for diagnostics.
+    bool convertColorProfile(LCMSColorProfile* fn_nullable targetColorProfile, const LCMSConversionOptions& options, long numThreads = 0, LCMSConversionPlan* fn_nullable plan fn_noescape = nullptr);
+    
+    /// Converts the image and marks the pixels the target profile can't reproduce in the `gamutMask`, in the same pass.
+    ///
+    /// The `options` have to enable the gamut check. The mask has `height` rows laid out as `gamutMaskFormat` says, pass `0` as `gamutMaskBytesPerRow` for tightly packed rows.
+    bool convertColorProfile(LCMSColorProfile* fn_nullable targetColorProfile, const LCMSConversionOptions& options, void* fn_nonnull gamutMask, long gamutMaskBytesPerRow, long numThreads = 0);
     
     char* fn_nonnull getData() SWIFT_COMPUTED_PROPERTY { return _data; }
     long getDataSize() SWIFT_COMPUTED_PROPERTY { return _width * _height * _numComponents * _componentSize; }
@@ -63,13 +89,18 @@ public:
     long getComponentSize() const SWIFT_COMPUTED_PROPERTY { return _componentSize; }
     bool getIsHDR() const SWIFT_COMPUTED_PROPERTY { return _isHDR; }
     LCMSColorProfile* fn_nullable getColorProfile() SWIFT_COMPUTED_PROPERTY SWIFT_RETURNS_UNRETAINED { return _colorProfile; }
+    LCMSContext* fn_nonnull getContext() SWIFT_COMPUTED_PROPERTY SWIFT_RETURNS_UNRETAINED { return _context; }
 } SWIFT_SHARED_REFERENCE(LCMSImageRetain, LCMSImageRelease);
 
 
 /// Don't uset it. Instead, use the ``LCMSImage/convertColorProfile`` method.
+///
+/// There's no gamut mask to fill, so `options` with the gamut check enabled are rejected. The transform is built and cached in the `context`, or in the default context if it's not specified.
 LCMSImage* fn_nullable convertToLinearDCIP3(const char* fn_nonnull sourceData,
                                             long width, long height,
                                             long numComponents, long componentSize,
                                             bool isHDR,
-                                            const char* fn_nullable iccpData, long iccpLength
+                                            const char* fn_nullable iccpData, long iccpLength,
+                                            const LCMSConversionOptions& options = LCMSConversionOptions(),
+                                            LCMSContext* fn_nullable context = nullptr
                                             ) SWIFT_RETURNS_RETAINED;
@@ -0,0 +1,132 @@
+//
+//  LCMSTransform.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <LCMS2C/ConversionOptions.hpp>
+#include <memory>
+
+
+class LCMSColorProfile;
+class LCMSContext;
+class LCMSImage;
+class LCMSCachedTransform;
+class LCMSGamutChecker;
+
+
+/// Colour transform from one colour profile to another.
+///
+/// Build it once and apply it as many times as needed - the expensive transform construction is done only on creation. Transforms with the same parameters share the same underlying lcms transform.
+///
+/// - Note: A transform can be applied from multiple threads at the same time.
+class LCMSTransform final {
+private:
+    std::atomic<size_t> _referenceCounter;
+    
+    /// Context the transform was created and cached in.
+    LCMSContext* fn_nonnull _context;
+    std::shared_ptr<LCMSCachedTransform> _transform;
+    
+    /// Only built if the gamut check is enabled.
+    std::shared_ptr<LCMSGamutChecker> _gamutChecker;
+    
+    /// If no color profile is specified, it's assumed to be `sRGB`.
+    LCMSColorProfile* fn_nullable _sourceColorProfile;
+    LCMSColorProfile* fn_nullable _targetColorProfile;
+    
+    long _inputNumComponents;
+    long _inputComponentSize;
+    long _outputNumComponents;
+    long _outputComponentSize;
+    LCMSConversionOptions _options;
+    LCMSConversionPlan _plan;
+    
+    LCMSTransform(LCMSContext* fn_nonnull context, std::shared_ptr<LCMSCachedTransform> transform, std::shared_ptr<LCMSGamutChecker> gamutChecker,
+                  LCMSColorProfile* fn_nullable sourceColorProfile, LCMSColorProfile* fn_nullable targetColorProfile,
+                  long inputNumComponents, long inputComponentSize,
+                  long outputNumComponents, long outputComponentSize,
+                  const LCMSConversionOptions& options, LCMSConversionPlan plan);
+    ~LCMSTransform();
+    
+    void _transformLines(const char* fn_nonnull source, char* fn_nonnull destination, long width, long height, long sourceBytesPerRow, long destinationBytesPerRow, long numThreads);
+    
+    FN_FRIEND_SWIFT_INTERFACE(LCMSTransform)
+    
+public:
+    /// Creates a transform from the `sourceColorProfile` to the `targetColorProfile`.
+    ///
+    /// If no color profile is specified, it's assumed to be `sRGB`.
+    ///
+    /// With automatic precalculation, `expectedNumPixels` tells the planner how many pixels the transform is going to process, so that it can decide if building a lookup table pays off. Pass `0` for a transform that is reused a lot.
+    ///
+    /// The transform is built and cached in the `context`, or in the default context if it's not specified.
+    static LCMSTransform* fn_nullable create(LCMSColorProfile* fn_nullable sourceColorProfile,
+                                             LCMSColorProfile* fn_nullable targetColorProfile,
+                                             long inputNumComponents, long inputComponentSize,
+                                             long outputNumComponents, long outputComponentSize,
+                                             const LCMSConversionOptions& options = LCMSConversionOptions(),
+                                             long expectedNumPixels = 0,
+                                             LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
+    
+    /// Creates a transform that keeps the pixel format.
+    static LCMSTransform* fn_nullable create(LCMSColorProfile* fn_nullable sourceColorProfile,
+                                             LCMSColorProfile* fn_nullable targetColorProfile,
+                                             long numComponents, long componentSize,
+                                             const LCMSConversionOptions& options = LCMSConversionOptions(),
+                                             long expectedNumPixels = 0,
+                                             LCMSContext* fn_nullable context = nullptr) SWIFT_RETURNS_RETAINED;
+    
+    /// Transforms the `image` into a new image with the target colour profile and the transform's output pixel format.
+    ///
+    /// The image's pixel format has to match the transform's input pixel format.
+    ///
+    /// Large images are split into slices that are transformed on up to `numThreads` threads. Pass `0` to use the context's `maxWorkers` limit, or `1` to stay on the calling thread.
+    LCMSImage* fn_nullable apply(LCMSImage* fn_nonnull image, long numThreads = 0) SWIFT_RETURNS_RETAINED;
+    
+    /// Transforms `height` rows of `width` pixels.
+    ///
+    /// Pass `0` as bytes per row for tightly packed rows. `source` and `destination` may be the same buffer if the input and output pixel sizes are equal.
+    ///
+    /// Large images are split into slices that are transformed on up to `numThreads` threads. Pass `0` to use the context's `maxWorkers` limit, or `1` to stay on the calling thread.
+    bool apply(const void* fn_nonnull source, void* fn_nonnull destination, long width, long height, long sourceBytesPerRow = 0, long destinationBytesPerRow = 0, long numThreads = 0);
+    
+    /// Transforms `height` rows of `width` pixels and marks the source pixels the target profile can't reproduce in the `gamutMask`.
+    ///
+    /// The transform has to be created with the gamut check enabled. Mask rows are laid out as the options' `gamutMaskFormat` says, pass `0` as `gamutMaskBytesPerRow` for tightly packed rows. Each row is checked right before it's converted, so in-place conversion works the same as with ``apply``.
+    bool applyWithGamutMask(const void* fn_nonnull source, void* fn_nonnull destination, void* fn_nonnull gamutMask, long width, long height, long sourceBytesPerRow = 0, long destinationBytesPerRow = 0, long gamutMaskBytesPerRow = 0, long numThreads = 0);
+    
+    /// Transforms a single row of `numPixels` pixels.
+    ///
+    /// `source` and `destination` may be the same buffer if the input and output pixel sizes are equal.
+    bool applyRow(const void* fn_nonnull source, void* fn_nonnull destination, long numPixels);
+    
+    LCMSContext* fn_nonnull getContext() SWIFT_COMPUTED_PROPERTY SWIFT_RETURNS_UNRETAINED { return _context; }
+    LCMSColorProfile* fn_nullable getSourceColorProfile() SWIFT_COMPUTED_PROPERTY SWIFT_RETURNS_UNRETAINED { return _sourceColorProfile; }
+    LCMSColorProfile* fn_nullable getTargetColorProfile() SWIFT_COMPUTED_PROPERTY SWIFT_RETURNS_UNRETAINED { return _targetColorProfile; }
+    long getInputNumComponents() const SWIFT_COMPUTED_PROPERTY { return _inputNumComponents; }
+    long getInputComponentSize() const SWIFT_COMPUTED_PROPERTY { return _inputComponentSize; }
+    long getOutputNumComponents() const SWIFT_COMPUTED_PROPERTY { return _outputNumComponents; }
+    long getOutputComponentSize() const SWIFT_COMPUTED_PROPERTY { return _outputComponentSize; }
+    long getInputPixelSize() const SWIFT_COMPUTED_PROPERTY { return _inputNumComponents * _inputComponentSize; }
+    long getOutputPixelSize() const SWIFT_COMPUTED_PROPERTY { return _outputNumComponents * _outputComponentSize; }
+    LCMSConversionOptions getOptions() const SWIFT_COMPUTED_PROPERTY { return _options; }
+    
+    /// Precalculation strategy the transform was built with.
+    LCMSConversionPlan getPlan() const SWIFT_COMPUTED_PROPERTY { return _plan; }
+    
+    /// Sets the `maxWorkers` limit of the default context.
+    ///
+    /// - Seealso: ``LCMSContext/setMaxWorkers``
+    static void setMaxWorkers(long maxWorkers);
+    static long getMaxWorkers();
+}
+FN_SWIFT_INTERFACE(LCMSTransform)
+SWIFT_UNCHECKED_SENDABLE;
+
+
+FN_DEFINE_SWIFT_INTERFACE(LCMSTransform)
@@ -0,0 +1,47 @@
+//
+//  MemoryReport.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+
+
+/// What memory is used for.
+enum class LCMSMemoryCategory: long {
+    /// Pixel data owned by images.
+    pixels = 0,
+    
+    /// Temporary rows and buffers of conversions.
+    scratch,
+    
+    /// Transforms, pipelines and precalculated lookup tables.
+    lcms,
+    
+    /// ICC profile data and parsed profiles.
+    profiles
+};
+
+
+/// Bytes in each memory category.
+struct LCMSMemoryUsage {
+    long pixels;
+    long scratch;
+    long lcms;
+    long profiles;
+    
+    /// All categories together.
+    long total;
+};
+
+
+/// Current and peak memory usage.
+///
+/// Peaks are tracked per category, so the peak `total` may be less than the sum of the category peaks.
+struct LCMSMemoryReport {
+    LCMSMemoryUsage current;
+    LCMSMemoryUsage peak;
+};
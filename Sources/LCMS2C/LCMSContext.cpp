@@ -0,0 +1,323 @@
+//
+//  LCMSContext.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include <LCMS2C/LCMSContext.hpp>
+#include "TransformCache.hpp"
+#include "ProfileTable.hpp"
+#include "ConversionPlanner.hpp"
+#include "TransformScheduler.hpp"
+#include "HalfFormatters.hpp"
+#include "MatrixShaper.hpp"
+#include "MemoryPool.hpp"
+#include "MemoryTracker.hpp"
+#include "LogScope.hpp"
+#include <lcms2.h>
+#include <thread>
+#include <algorithm>
+
+
+/// Upper limit of lcms context copies per context.
+static constexpr long maxShards = 64;
+
+
+LCMSContext::LCMSContext(LCMSAllocator allocator, long numShards):
+_referenceCounter(1),
+_context(nullptr),
+_allocator(allocator),
+_numShards(std::clamp(numShards > 0 ? numShards : static_cast<long>(std::thread::hardware_concurrency()), 1l, maxShards)),
+_shards(std::make_unique<std::atomic<_cmsContext_struct*>[]>(_numShards)),
+_transformCache(std::make_unique<LCMSTransformCache>(LCMSTransformCache::defaultCapacity)),
+_profilePairCache(std::make_unique<LCMSProfilePairCache>()),
+_profileTable(std::make_unique<LCMSProfileTable>()),
+_maxWorkers(0),
+_memoryTracker(LCMSMemoryTracker::create()),
+_logHandler(nullptr),
+_logUserData(nullptr) {
+    //
+}
+
+
+LCMSContext::~LCMSContext() {
+    // Cached transforms were created in the lcms contexts
+    _transformCache = nullptr;
+    for (long i = 0; i < _numShards; i++) {
+        if (auto shard = _shards[i].load()) {
+            cmsDeleteContext(shard);
+        }
+    }
+    if (_context) {
+        cmsDeleteContext(_context);
+    }
+    
+    // Memory released later keeps the tracker alive
+    _memoryTracker->release();
+}
+
+
+static thread_local LCMSContext* currentLogContext = nullptr;
+
+
+LCMSLogScope::LCMSLogScope(LCMSContext* fn_nonnull context):
+_previousContext(currentLogContext) {
+    currentLogContext = context;
+}
+
+
+LCMSLogScope::~LCMSLogScope() {
+    currentLogContext = _previousContext;
+}
+
+
+LCMSContext* fn_nullable LCMSLogScope::current() {
+    return currentLogContext;
+}
+
+
+void LCMSContext::_logError(_cmsContext_struct* fn_nullable context, unsigned int errorCode, const char* fn_nullable message) {
+    if (message == nullptr) {
+        message = "Unknown error";
+    }
+    
+    // Profile contexts have no owner, their errors go to whoever is parsing them
+    auto owner = context ? static_cast<LCMSContext*>(cmsGetContextUserData(context)) : nullptr;
+    if (owner == nullptr) {
+        owner = LCMSLogScope::current();
+    }
+    if (owner) {
+        std::lock_guard lock(owner->_logMutex);
+        if (owner->_logHandler) {
+            owner->_logHandler(owner->_logUserData, errorCode, message);
+            return;
+        }
+    }
+    
+    printf("Error: %s\n", message);
+}
+
+
+static void* fn_nullable memoryHandlerOf(LCMSAllocator allocator) {
+    switch (allocator) {
+        case LCMSAllocator::pooled:
+            return lcmsPoolMemoryHandler();
+            
+        case LCMSAllocator::system:
+            return lcmsSystemMemoryHandler();
+            
+        default:
+            return nullptr;
+    }
+}
+
+
+_cmsContext_struct* fn_nullable LCMSContext::_createHandle(void* fn_nullable owner) {
+    // cmsDupContext allocates the copy with the memory handler, but cmsDeleteContext frees it with the system allocator. So every lcms context is created from scratch, the memory handler can only be set up here
+    auto handle = cmsCreateContext(memoryHandlerOf(_allocator), owner);
+    if (handle == nullptr) {
+        printf("Could not create lcms context\n");
+        return nullptr;
+    }
+    
+    if (lcmsInstallTransformScheduler(handle) == false) {
+        printf("Could not install the transform scheduler\n");
+    }
+    if (lcmsInstallHalfFormatters(handle) == false) {
+        printf("Could not install half float formatters\n");
+    }
+    if (lcmsInstallMatrixShaperTransforms(handle) == false) {
+        printf("Could not install matrix-shaper transforms\n");
+    }
+    
+    cmsSetLogErrorHandlerTHR(handle, _logError);
+    
+    // Settings of an existing context
+    if (_context) {
+        cmsUInt16Number codes[cmsMAXCHANNELS];
+        cmsGetAlarmCodesTHR(_context, codes);
+        cmsSetAlarmCodesTHR(handle, codes);
+        cmsSetAdaptationStateTHR(handle, cmsSetAdaptationStateTHR(_context, -1));
+    }
+    
+    return handle;
+}
+
+
+LCMSContext* fn_nullable LCMSContext::create(LCMSAllocator allocator, long numShards) {
+    if (memoryHandlerOf(allocator) == nullptr) {
+        printf("Invalid allocator: %ld\n", static_cast<long>(allocator));
+        return nullptr;
+    }
+    
+    if (numShards < 0) {
+        printf("Invalid number of shards: %ld\n", numShards);
+        return nullptr;
+    }
+    
+    auto context = new LCMSContext(allocator, numShards);
+    context->_context = context->_createHandle(context);
+    if (context->_context == nullptr) {
+        delete context;
+        return nullptr;
+    }
+    
+    return context;
+}
+
+
+LCMSContext* fn_nullable LCMSContext::duplicate() {
+    auto context = new LCMSContext(_allocator, _numShards);
+    
+    // Alarm codes and adaptation state are copied from this context's handle
+    {
+        std::lock_guard lock(_settingsMutex);
+        context->_context = _createHandle(context);
+    }
+    if (context->_context == nullptr) {
+        delete context;
+        return nullptr;
+    }
+    
+    context->_maxWorkers = _maxWorkers.load();
+    {
+        std::lock_guard lock(_logMutex);
+        context->_logHandler = _logHandler;
+        context->_logUserData = _logUserData;
+    }
+    
+    return context;
+}
+
+
+_cmsContext_struct* fn_nullable LCMSContext::createProfileHandle() {
+    std::lock_guard lock(_settingsMutex);
+    return _createHandle(nullptr);
+}
+
+
+LCMSContext* fn_nonnull LCMSContext::getDefault() {
+    // Intentionally leaked, cached transforms and static profiles may outlive static destruction
+    static auto context = []() {
+        auto context = create();
+        if (context == nullptr) {
+            printf("Could not create the default context\n");
+            abort();
+        }
+        return context;
+    }();
+    return context;
+}
+
+
+_cmsContext_struct* fn_nonnull LCMSContext::getThreadHandle() {
+    // Threads are assigned to shards round-robin in the order they first ask for one
+    static std::atomic<long> nextThreadIndex = 0;
+    static thread_local long threadIndex = nextThreadIndex.fetch_add(1);
+    
+    auto& shard = _shards[threadIndex % _numShards];
+    auto handle = shard.load(std::memory_order_acquire);
+    if (handle) {
+        return handle;
+    }
+    
+    // Settings are changed under the same lock, so a new shard can't miss one
+    std::lock_guard lock(_settingsMutex);
+    handle = shard.load(std::memory_order_acquire);
+    if (handle == nullptr) {
+        handle = _createHandle(this);
+        if (handle == nullptr) {
+            return _context;
+        }
+        shard.store(handle, std::memory_order_release);
+    }
+    return handle;
+}
+
+
+void LCMSContext::setLogHandler(LCMSLogHandler fn_nullable handler, void* fn_nullable userData) {
+    std::lock_guard lock(_logMutex);
+    _logHandler = handler;
+    _logUserData = userData;
+}
+
+
+void LCMSContext::setAlarmCode(long channel, unsigned short value) {
+    if (channel < 0 || channel >= cmsMAXCHANNELS) {
+        printf("Invalid alarm code channel: %ld\n", channel);
+        return;
+    }
+    
+    {
+        std::lock_guard lock(_settingsMutex);
+        cmsUInt16Number codes[cmsMAXCHANNELS];
+        cmsGetAlarmCodesTHR(_context, codes);
+        codes[channel] = value;
+        _forEachHandle([&](cmsContext handle) {
+            cmsSetAlarmCodesTHR(handle, codes);
+        });
+    }
+    
+    clearTransformCache();
+}
+
+
+unsigned short LCMSContext::getAlarmCode(long channel) {
+    if (channel < 0 || channel >= cmsMAXCHANNELS) {
+        printf("Invalid alarm code channel: %ld\n", channel);
+        return 0;
+    }
+    
+    cmsUInt16Number codes[cmsMAXCHANNELS];
+    cmsGetAlarmCodesTHR(_context, codes);
+    return codes[channel];
+}
+
+
+void LCMSContext::setAdaptationState(double adaptationState) {
+    {
+        std::lock_guard lock(_settingsMutex);
+        _forEachHandle([&](cmsContext handle) {
+            cmsSetAdaptationStateTHR(handle, std::clamp(adaptationState, 0.0, 1.0));
+        });
+    }
+    
+    clearTransformCache();
+}
+
+
+double LCMSContext::getAdaptationState() {
+    // Negative values only query the state
+    return cmsSetAdaptationStateTHR(_context, -1);
+}
+
+
+void LCMSContext::setMaxWorkers(long maxWorkers) {
+    _maxWorkers = std::max(0l, maxWorkers);
+}
+
+
+void LCMSContext::clearTransformCache() {
+    _transformCache->clear();
+}
+
+
+LCMSMemoryReport LCMSContext::getMemoryReport() const {
+    return _memoryTracker->getReport();
+}
+
+
+void LCMSContext::resetPeakMemoryUsage() {
+    _memoryTracker->resetPeak();
+}
+
+
+LCMSMemoryReport LCMSContext::getLastConversionMemoryReport() {
+    return LCMSConversionMemoryScope::getLastReport();
+}
+
+
+//
+
+FN_IMPLEMENT_SWIFT_INTERFACE1(LCMSContext)
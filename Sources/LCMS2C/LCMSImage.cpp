@@ -7,63 +7,18 @@
 
 #include <LCMS2C/LCMSImage.hpp>
 #include <LCMS2C/ColorProfile.hpp>
+#include <LCMS2C/LCMSTransform.hpp>
+#include <LCMS2C/LCMSContext.hpp>
+#include "TransformCache.hpp"
+#include "ComponentConverter.hpp"
+#include "ConversionOptions.hpp"
+#include "ConversionPlanner.hpp"
+#include "MemoryTracker.hpp"
 #include <lcms2.h>
 #include <algorithm>
 
 
-struct ComponentConverter {
-    static cmsUInt32Number C1(long componentSize) {
-        switch (componentSize) {
-            case 1: return TYPE_GRAY_8;
-            case 2: return TYPE_GRAY_HALF_FLT;
-            case 4: return TYPE_GRAY_FLT;
-            default: return 0;
-        }
-    }
-    
-    static cmsUInt32Number C2(long componentSize) {
-        switch (componentSize) {
-            case 1: return TYPE_GRAYA_8;
-            // TODO: no TYPE_GRAYA_HALF_FLT?
-            //case 2: return TYPE_GRAY_HALF_FLT;
-            case 2: return TYPE_GRAYA_16_SE;
-            case 4: return TYPE_GRAYA_FLT;
-            default: return 0;
-        }
-    }
-    
-    static cmsUInt32Number C3(long componentSize) {
-        switch (componentSize) {
-            case 1: return TYPE_RGB_8;
-            case 2: return TYPE_RGB_HALF_FLT;
-            case 4: return TYPE_RGB_FLT;
-            default: return 0;
-        }
-    }
-    
-    static cmsUInt32Number C4(long componentSize) {
-        switch (componentSize) {
-            case 1: return TYPE_RGBA_8;
-            case 2: return TYPE_RGBA_HALF_FLT;
-            case 4: return TYPE_RGBA_FLT;
-            default: return 0;
-        }
-    }
-    
-    // TODO: Add flag for alpha (true = alpha is ignored (TYPE_RGBA_8), false = convert alpha (TYPE_RGBA_8_PLANAR))
-    static cmsUInt32Number calculate(long numComponents, long componentSize) {
-        switch (numComponents) {
-            case 1: return ComponentConverter::C1(componentSize);
-            case 2: return ComponentConverter::C2(componentSize);
-            case 3: return ComponentConverter::C3(componentSize);
-            case 4: return ComponentConverter::C4(componentSize);
-            default: return 0;
-        }
-    }
-};
-
-
-LCMSImage::LCMSImage(char* fn_nonnull data, bool borrowingData, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile):
+LCMSImage::LCMSImage(char* fn_nonnull data, bool borrowingData, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile, LCMSContext* fn_nonnull context):
 _referenceCounter(1),
 _data(data),
 _borrowingData(borrowingData),
@@ -72,20 +27,27 @@ _height(height),
 _numComponents(numComponents),
 _componentSize(componentSize),
 _isHDR(isHDR),
-_colorProfile(colorProfile) {
-    //
+_colorProfile(colorProfile),
+_context(LCMSContextRetain(context)),
+_memoryTracker(nullptr) {
+    if (_borrowingData == false) {
+        _memoryTracker = LCMSMemoryTracker::select(_context->getMemoryTracker());
+        _memoryTracker->allocate(LCMSMemoryCategory::pixels, getDataSize());
+    }
 }
 
 LCMSImage::~LCMSImage() {
     //printf("Destroy LCMSImage\n");
     if (_borrowingData == false) {
         delete [] _data;
+        _memoryTracker->deallocate(LCMSMemoryCategory::pixels, getDataSize());
     }
     LCMSColorProfileRelease(_colorProfile);
+    LCMSContextRelease(_context);
 }
 
 
-LCMSImage* fn_nullable LCMSImage::create(const char* fn_nonnull data, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile) {
+LCMSImage* fn_nullable LCMSImage::create(const char* fn_nonnull data, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile, LCMSContext* fn_nullable context) {
     // Invalid size
     if (width < 1 || height < 1) {
         return nullptr;
@@ -106,11 +68,11 @@ LCMSImage* fn_nullable LCMSImage::create(const char* fn_nonnull data, long width
     auto dataCopy = new char[dataSize];
     memcpy(dataCopy, data, dataSize);
     
-    return new LCMSImage(dataCopy, false, width, height, numComponents, componentSize, isHDR, LCMSColorProfileRetain(colorProfile));
+    return new LCMSImage(dataCopy, false, width, height, numComponents, componentSize, isHDR, LCMSColorProfileRetain(colorProfile), lcmsContextOrDefault(context));
 }
 
 
-LCMSImage* fn_nullable LCMSImage::createBorrowing(char* fn_nonnull data, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile) {
+LCMSImage* fn_nullable LCMSImage::createBorrowing(char* fn_nonnull data, long width, long height, long numComponents, long componentSize, bool isHDR, LCMSColorProfile* fn_nullable colorProfile, LCMSContext* fn_nullable context) {
     // Invalid size
     if (width < 1 || height < 1) {
         return nullptr;
@@ -126,137 +88,67 @@ LCMSImage* fn_nullable LCMSImage::createBorrowing(char* fn_nonnull data, long wi
         return nullptr;
     }
     
-    return new LCMSImage(data, true, width, height, numComponents, componentSize, isHDR, LCMSColorProfileRetain(colorProfile));
+    return new LCMSImage(data, true, width, height, numComponents, componentSize, isHDR, LCMSColorProfileRetain(colorProfile), lcmsContextOrDefault(context));
 }
 
 
-static cmsHPROFILE fn_nullable _createProfileOrSRGB(LCMSColorProfile* fn_nonnull profile) {
-    if (profile) {
-        return cmsOpenProfileFromMem(profile->getData(), static_cast<cmsUInt32Number>(profile->getSize()));
-    }
-    
-    return cmsCreate_sRGBProfile();
+bool LCMSImage::convertColorProfile(LCMSColorProfile* fn_nullable targetColorProfile, long numThreads) {
+    return convertColorProfile(targetColorProfile, LCMSConversionOptions(), numThreads);
 }
 
 
-bool LCMSImage::convertColorProfile(LCMSColorProfile* fn_nullable targetColorProfile) {
-    // Create source color profile
-    auto srcProfile = _createProfileOrSRGB(_colorProfile);
-    if (srcProfile == nullptr) {
-        printf("Could not create source ICC profile\n");
-        return false;
-    }
+bool LCMSImage::convertColorProfile(LCMSColorProfile* fn_nullable targetColorProfile, const LCMSConversionOptions& options, long numThreads, LCMSConversionPlan* fn_nullable plan fn_noescape) {
+    LCMSConversionMemoryScope memory(_context->getMemoryTracker());
     
-    // Create destination color profile
-    auto dstProfile = _createProfileOrSRGB(targetColorProfile);
-    if (dstProfile == nullptr) {
-        printf("Could not create destination ICC profile\n");
-        cmsCloseProfile(srcProfile);
+    // Create transform
+    auto transform = LCMSTransform::create(_colorProfile, targetColorProfile, _numComponents, _componentSize, options, _width * _height, _context);
+    if (transform == nullptr) {
         return false;
     }
     
+    if (plan) {
+        *plan = transform->getPlan();
+    }
     
-    // Prepare proxy data - lcms accepts 2-byte images with two channels only as ushort, but we store it as half float to unlock hdr
-    auto proxyComponentSize = _componentSize;
-    auto proxyData = _data;
-    if (proxyComponentSize == 2 && _numComponents == 2) {
-        printf("Create proxy image\n");
-        proxyComponentSize = 4;
-        proxyData = new char[_width * _height * _numComponents * proxyComponentSize];
-        auto halfs = reinterpret_cast<__fp16*>(_data);
-        auto floats = reinterpret_cast<float*>(proxyData);
-        for (int y = 0; y < _height; y++) {
-            for (int x = 0; x < _width; x++) {
-                for (auto i = 0; i < _numComponents; i++) {
-                    auto index = (y * _width + x) * _numComponents + i;
-                    floats[index] = static_cast<float>(halfs[index]);
-                }
-            }
-        }
+    // Apply transformation in place - the pixel format doesn't change
+    auto success = transform->apply(_data, _data, _width, _height, 0, 0, numThreads);
+    LCMSTransformRelease(transform);
+    if (success == false) {
+        return false;
     }
     
+    // Set the new color profile
+    LCMSColorProfileRetain(targetColorProfile);
+    LCMSColorProfileRelease(_colorProfile);
+    _colorProfile = targetColorProfile;
     
-    // Create transform
-    cmsUInt32Number format = ComponentConverter::calculate(_numComponents, proxyComponentSize);
-    //cmsHTRANSFORM transform = cmsCreateTransform(srcProfile, format,
-    //                                             dstProfile, format,
-    //                                             //srcProfile, inputFormat,
-    //                                             INTENT_ABSOLUTE_COLORIMETRIC,
-    //                                             0 |
-    //                                             cmsFLAGS_HIGHRESPRECALC |
-    //                                             //cmsFLAGS_GAMUTCHECK |
-    //                                             cmsFLAGS_NOOPTIMIZE |
-    //                                             cmsFLAGS_NONEGATIVES |
-    //                                             cmsFLAGS_COPY_ALPHA
-    //                                             );
-    
-    cmsUInt32Number flags = cmsFLAGS_NOCACHE |
-    cmsFLAGS_NOOPTIMIZE |
-    cmsFLAGS_HIGHRESPRECALC |
-    cmsFLAGS_GAMUTCHECK |
-    cmsFLAGS_NOWHITEONWHITEFIXUP |
-    cmsFLAGS_NONEGATIVES;
-    // TODO: Check if image contains alpha channel
-    if (true) {
-        flags |= cmsFLAGS_COPY_ALPHA;
+    // Success
+    return true;
+}
+
+
+bool LCMSImage::convertColorProfile(LCMSColorProfile* fn_nullable targetColorProfile, const LCMSConversionOptions& options, void* fn_nonnull gamutMask, long gamutMaskBytesPerRow, long numThreads) {
+    if (options.gamutCheck == false) {
+        printf("Gamut mask requires the gamut check to be enabled\n");
+        return false;
     }
     
-    cmsHTRANSFORM transform = cmsCreateTransform(srcProfile, format,
-                                                 dstProfile, format,
-                                                 //srcProfile, inputFormat,
-                                                 INTENT_ABSOLUTE_COLORIMETRIC,
-                                                 flags);
+    LCMSConversionMemoryScope memory(_context->getMemoryTracker());
+    auto transform = LCMSTransform::create(_colorProfile, targetColorProfile, _numComponents, _componentSize, options, _width * _height, _context);
     if (transform == nullptr) {
-        printf("Could not create color profile transform\n");
-        cmsCloseProfile(dstProfile);
-        cmsCloseProfile(srcProfile);
         return false;
     }
     
-    // Create temporary pixel data
-    auto imageDataSize = _width * _height * _numComponents * proxyComponentSize;
-    auto tmpData = new char[imageDataSize];
-    
-    // Apply transformation
-    for (int y = 0; y < _height; y++) {
-        // TODO: Why not the whole image at once?
-        cmsDoTransform(transform, proxyData + _width * proxyComponentSize * _numComponents * y,
-                       tmpData + _width * proxyComponentSize * _numComponents * y,
-                       static_cast<cmsUInt32Number>(_width));
-    }
-    
-    // Copy transformed data
-    std::memcpy(proxyData, tmpData, imageDataSize);
-    
-    // Transform proxy data back to half float if needed
-    if (proxyData != _data) {
-        auto halfs = reinterpret_cast<__fp16*>(_data);
-        auto floats = reinterpret_cast<float*>(proxyData);
-        for (int y = 0; y < _height; y++) {
-            for (int x = 0; x < _width; x++) {
-                for (auto i = 0; i < _numComponents; i++) {
-                    auto index = (y * _width + x) * _numComponents + i;
-                    halfs[index] = static_cast<__fp16>(floats[index]);
-                }
-            }
-        }
-        
-        delete [] proxyData;
+    auto success = transform->applyWithGamutMask(_data, _data, gamutMask, _width, _height, 0, 0, gamutMaskBytesPerRow, numThreads);
+    LCMSTransformRelease(transform);
+    if (success == false) {
+        return false;
     }
-    proxyData = nullptr;
-    
-    // Clean up
-    delete [] tmpData;
-    cmsDeleteTransform(transform);
-    cmsCloseProfile(dstProfile);
-    cmsCloseProfile(srcProfile);
     
-    // Set the new color profile
     LCMSColorProfileRetain(targetColorProfile);
     LCMSColorProfileRelease(_colorProfile);
     _colorProfile = targetColorProfile;
     
-    // Success
     return true;
 }
 
@@ -279,11 +171,96 @@ void LCMSImageRelease(LCMSImage* fn_nullable container) {
 
 //
 
+/// Linear DCI-P3 profile used by ``convertToLinearDCIP3``.
+///
+/// Built once and kept for the whole process lifetime, so that neither the profile nor its serialisation is recreated per call.
+static LCMSColorProfile* fn_nullable _linearDCIP3Profile() {
+    static auto colorProfile = []() -> LCMSColorProfile* {
+        // Create linear DCI-P3 profile
+#if 1
+        // D65 white point
+        cmsCIExyY D65;
+        cmsWhitePointFromTemp(&D65, 6504);
+        
+        // ChatGPT
+#if 0
+        cmsCIExyYTRIPLE primaries = {
+            { 0.680, 0.32, 1.0 },  // Red
+            { 0.265, 0.69, 1.0 },  // Green
+            { 0.150, 0.06, 1.0 }   // Blue
+        };
+#else
+        cmsCIExyYTRIPLE primaries = {
+            { 0.680, 0.32, 0.0   },  // Red
+            { 0.265, 0.69, 0.045 },  // Green
+            { 0.150, 0.06, 0.79  }   // Blue
+        };
+#endif
+        
+        // Linear transfer function
+        auto context = LCMSContext::getDefault()->getHandle();
+        cmsToneCurve* linear = cmsBuildGamma(context, 1.0);
+        cmsToneCurve* transferFunction[3] = { linear, linear, linear };
+        
+        cmsHPROFILE dstProfile = cmsCreateRGBProfileTHR(context, &D65, &primaries, transferFunction);
+        //cmsHPROFILE dstProfile = cmsCreate_sRGBProfile();
+#else
+        cmsToneCurve* linear = cmsBuildGamma(nullptr, 1.0);
+        
+        // DCI-P3-D65.icc profile at
+        // https://www.color.org/chardata/rgb/DCIP3.xalter
+        unsigned char dciP3D65[] = { 0x00, 0x00, 0x02, 0x5C, 0x00, 0x00, 0x00, 0x00, 0x04, 0x30, 0x00, 0x00, 0x6D, 0x6E, 0x74, 0x72, 0x52, 0x47, 0x42, 0x20, 0x58, 0x59, 0x5A, 0x20, 0x07, 0xE1, 0x00, 0x06, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x61, 0x63, 0x73, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0xF6, 0xD6, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x43, 0x49, 0x47, 0x4C, 0x87, 0x78, 0x27, 0x40, 0xF3, 0xE3, 0xD1, 0x78, 0x46, 0x4D, 0x70, 0x67, 0xE9, 0xA2, 0x71, 0xE8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0B, 0x63, 0x70, 0x72, 0x74, 0x00, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x64, 0x64, 0x65, 0x73, 0x63, 0x00, 0x00, 0x01, 0x6C, 0x00, 0x00, 0x00, 0x30, 0x77, 0x74, 0x70, 0x74, 0x00, 0x00, 0x01, 0x9C, 0x00, 0x00, 0x00, 0x14, 0x63, 0x68, 0x61, 0x64, 0x00, 0x00, 0x01, 0xB0, 0x00, 0x00, 0x00, 0x2C, 0x72, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xDC, 0x00, 0x00, 0x00, 0x10, 0x67, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xEC, 0x00, 0x00, 0x00, 0x10, 0x62, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xFC, 0x00, 0x00, 0x00, 0x10, 0x72, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x0C, 0x00, 0x00, 0x00, 0x14, 0x67, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x20, 0x00, 0x00, 0x00, 0x14, 0x62, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x34, 0x00, 0x00, 0x00, 0x14, 0x6C, 0x75, 0x6D, 0x69, 0x00, 0x00, 0x02, 0x48, 0x00, 0x00, 0x00, 0x14, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x4B, 0x00, 0x00, 0x00, 0x48, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x72, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x74, 0x00, 0x69, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x6C, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6C, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x73, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x74, 0x00, 0x69, 0x00, 0x75, 0x00, 0x6D, 0x00, 0x2C, 0x00, 0x20, 0x00, 0x32, 0x00, 0x30, 0x00, 0x31, 0x00, 0x37, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x4B, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x44, 0x00, 0x43, 0x00, 0x49, 0x00, 0x20, 0x00, 0x50, 0x00, 0x33, 0x00, 0x20, 0x00, 0x44, 0x00, 0x36, 0x00, 0x35, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF6, 0xD5, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x73, 0x66, 0x33, 0x32, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0C, 0x44, 0x00, 0x00, 0x05, 0xDF, 0xFF, 0xFF, 0xF3, 0x26, 0x00, 0x00, 0x07, 0x94, 0x00, 0x00, 0xFD, 0x8F, 0xFF, 0xFF, 0xFB, 0xA1, 0xFF, 0xFF, 0xFD, 0xA2, 0x00, 0x00, 0x03, 0xDB, 0x00, 0x00, 0xC0, 0x75, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x83, 0xDF, 0x00, 0x00, 0x3D, 0xBF, 0xFF, 0xFF, 0xFF, 0xBB, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4A, 0xBF, 0x00, 0x00, 0xB1, 0x37, 0x00, 0x00, 0x0A, 0xB9, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x28, 0x38, 0x00, 0x00, 0x11, 0x0B, 0x00, 0x00, 0xC8, 0xB9, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+        cmsHPROFILE dstProfile = cmsOpenProfileFromMem(dciP3D65, static_cast<cmsUInt32Number>(sizeof(dciP3D65)));
+        if (dstProfile == nullptr) {
+            dstProfile = cmsCreate_sRGBProfile();
+        }
+#endif
+        
+        if (dstProfile == nullptr) {
+            printf("Could not create linear DCI-P3 profile\n");
+            cmsFreeToneCurve(linear);
+            return static_cast<LCMSColorProfile*>(nullptr);
+        }
+        
+        cmsUInt32Number iccProfileSize = 0;
+        char* iccProfileData = nullptr;
+        if (cmsSaveProfileToMem(dstProfile, nullptr, &iccProfileSize)) {
+            iccProfileData = new char[iccProfileSize];
+            
+            cmsSaveProfileToMem(dstProfile, iccProfileData, &iccProfileSize);
+        }
+        
+        // Cleanup
+        cmsCloseProfile(dstProfile);
+        cmsFreeToneCurve(linear);
+        
+        if (iccProfileData == nullptr) {
+            printf("Could not serialize linear DCI-P3 profile\n");
+            return static_cast<LCMSColorProfile*>(nullptr);
+        }
+        
+        auto profile = LCMSColorProfile::create(iccProfileData, iccProfileSize);
+        delete [] iccProfileData;
+        
+        return profile;
+    }();
+    
+    return colorProfile;
+}
+
+
 LCMSImage* fn_nullable convertToLinearDCIP3(const char* fn_nonnull sourceData,
                                             long width, long height,
                                             long numComponents, long componentSize,
                                             bool isHDR,
-                                            const char* fn_nullable iccData, long iccLength) {
+                                            const char* fn_nullable iccData, long iccLength,
+                                            const LCMSConversionOptions& options,
+                                            LCMSContext* fn_nullable context) {
+    if (options.gamutCheck) {
+        printf("Gamut check is not supported by convertToLinearDCIP3\n");
+        return nullptr;
+    }
+    
     if (width < 1) {
         printf("Invalid width: %ld\n", width);
         return nullptr;
@@ -304,65 +281,11 @@ LCMSImage* fn_nullable convertToLinearDCIP3(const char* fn_nonnull sourceData,
         return nullptr;
     }
     
-    cmsSetLogErrorHandler([](struct _cmsContext_struct *, unsigned int, const char * message) {
-        if (message) {
-            printf("Error: %s\n", message);
-        }
-        else {
-            printf("Unknown error\n");
-        }
-    });
-    
-    // Create source profile from the source image if presented
-    cmsHPROFILE srcProfile = nullptr;
-    // Import profile from the png iCCP chunk if presented
-    if (iccData != nullptr) {
-        srcProfile = cmsOpenProfileFromMem(iccData, static_cast<cmsUInt32Number>(iccLength));
-    }
-    // Or assume that it's sRGB
-    if (srcProfile == nullptr) {
-        srcProfile = cmsCreate_sRGBProfile();
-    }
-    
-    
-    // Create linear DCI-P3 profile
-#if 1
-    // D65 white point
-    cmsCIExyY D65;
-    cmsWhitePointFromTemp(&D65, 6504);
-    
-    // ChatGPT
-#if 0
-    cmsCIExyYTRIPLE primaries = {
-        { 0.680, 0.32, 1.0 },  // Red
-        { 0.265, 0.69, 1.0 },  // Green
-        { 0.150, 0.06, 1.0 }   // Blue
-    };
-#else
-    cmsCIExyYTRIPLE primaries = {
-        { 0.680, 0.32, 0.0   },  // Red
-        { 0.265, 0.69, 0.045 },  // Green
-        { 0.150, 0.06, 0.79  }   // Blue
-    };
-#endif
-    
-    // Linear transfer function
-    cmsToneCurve* linear = cmsBuildGamma(nullptr, 1.0);
-    cmsToneCurve* transferFunction[3] = { linear, linear, linear };
-    
-    cmsHPROFILE dstProfile = cmsCreateRGBProfile(&D65, &primaries, transferFunction);
-    //cmsHPROFILE dstProfile = cmsCreate_sRGBProfile();
-#else
-    cmsToneCurve* linear = cmsBuildGamma(nullptr, 1.0);
-    
-    // DCI-P3-D65.icc profile at
-    // https://www.color.org/chardata/rgb/DCIP3.xalter
-    unsigned char dciP3D65[] = { 0x00, 0x00, 0x02, 0x5C, 0x00, 0x00, 0x00, 0x00, 0x04, 0x30, 0x00, 0x00, 0x6D, 0x6E, 0x74, 0x72, 0x52, 0x47, 0x42, 0x20, 0x58, 0x59, 0x5A, 0x20, 0x07, 0xE1, 0x00, 0x06, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x61, 0x63, 0x73, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0xF6, 0xD6, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x43, 0x49, 0x47, 0x4C, 0x87, 0x78, 0x27, 0x40, 0xF3, 0xE3, 0xD1, 0x78, 0x46, 0x4D, 0x70, 0x67, 0xE9, 0xA2, 0x71, 0xE8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0B, 0x63, 0x70, 0x72, 0x74, 0x00, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x64, 0x64, 0x65, 0x73, 0x63, 0x00, 0x00, 0x01, 0x6C, 0x00, 0x00, 0x00, 0x30, 0x77, 0x74, 0x70, 0x74, 0x00, 0x00, 0x01, 0x9C, 0x00, 0x00, 0x00, 0x14, 0x63, 0x68, 0x61, 0x64, 0x00, 0x00, 0x01, 0xB0, 0x00, 0x00, 0x00, 0x2C, 0x72, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xDC, 0x00, 0x00, 0x00, 0x10, 0x67, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xEC, 0x00, 0x00, 0x00, 0x10, 0x62, 0x54, 0x52, 0x43, 0x00, 0x00, 0x01, 0xFC, 0x00, 0x00, 0x00, 0x10, 0x72, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x0C, 0x00, 0x00, 0x00, 0x14, 0x67, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x20, 0x00, 0x00, 0x00, 0x14, 0x62, 0x58, 0x59, 0x5A, 0x00, 0x00, 0x02, 0x34, 0x00, 0x00, 0x00, 0x14, 0x6C, 0x75, 0x6D, 0x69, 0x00, 0x00, 0x02, 0x48, 0x00, 0x00, 0x00, 0x14, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x4B, 0x00, 0x00, 0x00, 0x48, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x49, 0x00, 0x6E, 0x00, 0x74, 0x00, 0x65, 0x00, 0x72, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x74, 0x00, 0x69, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x61, 0x00, 0x6C, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6C, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x20, 0x00, 0x43, 0x00, 0x6F, 0x00, 0x6E, 0x00, 0x73, 0x00, 0x6F, 0x00, 0x72, 0x00, 0x74, 0x00, 0x69, 0x00, 0x75, 0x00, 0x6D, 0x00, 0x2C, 0x00, 0x20, 0x00, 0x32, 0x00, 0x30, 0x00, 0x31, 0x00, 0x37, 0x6D, 0x6C, 0x75, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x0C, 0x65, 0x6E, 0x55, 0x4B, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x44, 0x00, 0x43, 0x00, 0x49, 0x00, 0x20, 0x00, 0x50, 0x00, 0x33, 0x00, 0x20, 0x00, 0x44, 0x00, 0x36, 0x00, 0x35, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF6, 0xD5, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xD3, 0x2D, 0x73, 0x66, 0x33, 0x32, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0C, 0x44, 0x00, 0x00, 0x05, 0xDF, 0xFF, 0xFF, 0xF3, 0x26, 0x00, 0x00, 0x07, 0x94, 0x00, 0x00, 0xFD, 0x8F, 0xFF, 0xFF, 0xFB, 0xA1, 0xFF, 0xFF, 0xFD, 0xA2, 0x00, 0x00, 0x03, 0xDB, 0x00, 0x00, 0xC0, 0x75, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x63, 0x75, 0x72, 0x76, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x9A, 0x00, 0x00, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x83, 0xDF, 0x00, 0x00, 0x3D, 0xBF, 0xFF, 0xFF, 0xFF, 0xBB, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4A, 0xBF, 0x00, 0x00, 0xB1, 0x37, 0x00, 0x00, 0x0A, 0xB9, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x28, 0x38, 0x00, 0x00, 0x11, 0x0B, 0x00, 0x00, 0xC8, 0xB9, 0x58, 0x59, 0x5A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-    cmsHPROFILE dstProfile = cmsOpenProfileFromMem(dciP3D65, static_cast<cmsUInt32Number>(sizeof(dciP3D65)));
-    if (dstProfile == nullptr) {
-        dstProfile = cmsCreate_sRGBProfile();
+    // Linear DCI-P3 target profile
+    auto colorProfile = _linearDCIP3Profile();
+    if (colorProfile == nullptr) {
+        return nullptr;
     }
-#endif
     
     
     // Determine output component size
@@ -392,51 +315,81 @@ LCMSImage* fn_nullable convertToLinearDCIP3(const char* fn_nonnull sourceData,
     cmsUInt32Number inputFormat = ComponentConverter::calculate(numComponents, componentSize);
     cmsUInt32Number outputFormat = ComponentConverter::calculate(numComponents, outputComponentSize);
     
-    // Create transform from source to the destination profile
-    cmsHTRANSFORM transform = cmsCreateTransform(srcProfile, inputFormat,
-                                                 dstProfile, outputFormat,
-                                                 //srcProfile, inputFormat,
-                                                 INTENT_ABSOLUTE_COLORIMETRIC,
-                                                 0 |
-                                                 cmsFLAGS_HIGHRESPRECALC |
-                                                 cmsFLAGS_GAMUTCHECK |
-                                                 cmsFLAGS_NOOPTIMIZE |
-                                                 cmsFLAGS_NONEGATIVES |
-                                                 cmsFLAGS_COPY_ALPHA
-                                                 );
-    
-    
-    // Apply transformation
-    char* linearP3 = new char[width * height * numComponents * outputComponentSize];
-    for (int y = 0; y < height; y++) {
-        cmsDoTransform(transform, sourceData + width * componentSize * numComponents * y,
-                       linearP3 + width * outputComponentSize * numComponents * y,
-                       static_cast<cmsUInt32Number>(width));
-    }
+    // The source profile isn't parsed before a transform has to be built, so assume the more expensive kind
+    LCMSConversionTraits traits = {
+        .numPixels = width * height,
+        .inputFormat = inputFormat,
+        .outputFormat = outputFormat,
+        .sourceIsMatrixShaper = iccData == nullptr,
+        .targetIsMatrixShaper = true,
+        .profileMatch = LCMSProfileMatch::different
+    };
     
+    cmsUInt32Number flags = 0;
+    if (lcmsConversionFlags(options, lcmsPlanConversion(options, traits), flags) == false) {
+        return nullptr;
+    }
     
-    cmsUInt32Number iccProfileSize = 0;
-    char* iccProfileData = nullptr;
-    if (cmsSaveProfileToMem(dstProfile, nullptr, &iccProfileSize)) {
-        iccProfileData = new char[iccProfileSize];
+    // Get the transform from source to the destination profile
+    LCMSTransformKey key = {
+        .sourceProfile = LCMSTransformKey::identify(iccData, iccLength),
+        .targetProfile = LCMSTransformKey::identify(colorProfile),
+        .inputFormat = inputFormat,
+        .outputFormat = outputFormat,
+        .intent = lcmsConversionIntent(options),
+        .flags = flags
+    };
+    context = lcmsContextOrDefault(context);
+    LCMSConversionMemoryScope memory(context->getMemoryTracker());
+    auto contextHandle = context->getThreadHandle();
+    auto cachedTransform = context->getTransformCache().get(key, [&]() -> LCMSTransformReference {
+        // Create source profile from the source image if presented
+        cmsHPROFILE srcProfile = nullptr;
+        // Import profile from the png iCCP chunk if presented
+        if (iccData != nullptr) {
+            srcProfile = cmsOpenProfileFromMemTHR(contextHandle, iccData, static_cast<cmsUInt32Number>(iccLength));
+        }
+        // Or assume that it's sRGB
+        if (srcProfile == nullptr) {
+            srcProfile = cmsCreate_sRGBProfileTHR(contextHandle);
+        }
+        
+        cmsHPROFILE dstProfile = colorProfile->getHandle();
+        if (dstProfile == nullptr) {
+            printf("Could not open linear DCI-P3 profile\n");
+            cmsCloseProfile(srcProfile);
+            return nullptr;
+        }
         
-        cmsSaveProfileToMem(dstProfile, iccProfileData, &iccProfileSize);
+        auto transform = cmsCreateTransformTHR(contextHandle,
+                                               srcProfile, key.inputFormat,
+                                               dstProfile, key.outputFormat,
+                                               key.intent,
+                                               key.flags);
+        
+        cmsCloseProfile(srcProfile);
+        
+        if (transform == nullptr) {
+            return nullptr;
+        }
+        
+        return std::make_shared<LCMSCachedTransform>(transform, nullptr, colorProfile);
+    });
+    if (cachedTransform == nullptr) {
+        printf("Could not create color profile transform\n");
+        return nullptr;
     }
+    auto transform = cachedTransform->get();
     
     
-    // Cleanup
-    cmsDeleteTransform(transform);
-    cmsCloseProfile(srcProfile);
-    cmsCloseProfile(dstProfile);
-    cmsFreeToneCurve(linear);
-    
-    auto colorProfile = LCMSColorProfile::create(iccProfileData, iccProfileSize);
-    
-    auto image = LCMSImage::create(linearP3, width, height, numComponents, outputComponentSize, isHDR, colorProfile);
-    
-    LCMSColorProfileRelease(colorProfile);
-    delete [] iccProfileData;
-    delete [] linearP3;
+    // Apply transformation straight into the new image's pixels, every byte is written by the transform
+    auto destination = new char[width * height * numComponents * outputComponentSize];
+    auto image = new LCMSImage(destination, false, width, height, numComponents, outputComponentSize, isHDR, LCMSColorProfileRetain(colorProfile), context);
+    cmsDoTransformLineStride(transform, sourceData, destination,
+                             static_cast<cmsUInt32Number>(width), static_cast<cmsUInt32Number>(height),
+                             static_cast<cmsUInt32Number>(width * componentSize * numComponents),
+                             static_cast<cmsUInt32Number>(width * outputComponentSize * numComponents),
+                             0, 0);
     
 #if 0
     // Compare data
@@ -445,7 +398,7 @@ LCMSImage* fn_nullable convertToLinearDCIP3(const char* fn_nonnull sourceData,
     
     auto count = std::min(oldDataSize / 2, newDataSize / 2);
     auto buf1 = reinterpret_cast<const unsigned short*>(sourceData);
-    auto buf2 = reinterpret_cast<const unsigned short*>(linearP3);
+    auto buf2 = reinterpret_cast<const unsigned short*>(image->getData());
     for (auto i = 0; i < count; i++) {
         auto val1 = buf1[i];
         auto val2 = buf2[i];
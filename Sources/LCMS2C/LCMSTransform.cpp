@@ -0,0 +1,332 @@
+//
+//  LCMSTransform.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include <LCMS2C/LCMSTransform.hpp>
+#include <LCMS2C/LCMSImage.hpp>
+#include <LCMS2C/ColorProfile.hpp>
+#include <LCMS2C/LCMSContext.hpp>
+#include "TransformCache.hpp"
+#include "ProfileHandle.hpp"
+#include "ComponentConverter.hpp"
+#include "ConversionOptions.hpp"
+#include "ConversionPlanner.hpp"
+#include "TransformScheduler.hpp"
+#include "GamutCheck.hpp"
+#include "ThreadPool.hpp"
+#include "MemoryTracker.hpp"
+#include "LogScope.hpp"
+#include <lcms2.h>
+#include <algorithm>
+
+
+/// Rows of a gamut checked conversion are split into bands of at least this many pixels.
+static constexpr long minPixelsPerBand = 64 * 1024;
+
+
+static bool validatePixelFormat(long numComponents, long componentSize) {
+    // Invalid number of components
+    if (numComponents < 1 || numComponents > 4) {
+        printf("Invalid number of components: %ld\n", numComponents);
+        return false;
+    }
+    
+    // Invalid component size
+    if (componentSize != 1 && componentSize != 2 && componentSize != 4) {
+        printf("Invalid component size: %ld\n", componentSize);
+        return false;
+    }
+    
+    return true;
+}
+
+
+LCMSTransform::LCMSTransform(LCMSContext* fn_nonnull context, std::shared_ptr<LCMSCachedTransform> transform, std::shared_ptr<LCMSGamutChecker> gamutChecker,
+                             LCMSColorProfile* fn_nullable sourceColorProfile, LCMSColorProfile* fn_nullable targetColorProfile,
+                             long inputNumComponents, long inputComponentSize,
+                             long outputNumComponents, long outputComponentSize,
+                             const LCMSConversionOptions& options, LCMSConversionPlan plan):
+_referenceCounter(1),
+_context(LCMSContextRetain(context)),
+_transform(std::move(transform)),
+_gamutChecker(std::move(gamutChecker)),
+_sourceColorProfile(LCMSColorProfileRetain(sourceColorProfile)),
+_targetColorProfile(LCMSColorProfileRetain(targetColorProfile)),
+_inputNumComponents(inputNumComponents),
+_inputComponentSize(inputComponentSize),
+_outputNumComponents(outputNumComponents),
+_outputComponentSize(outputComponentSize),
+_options(options),
+_plan(plan) {
+    //
+}
+
+
+LCMSTransform::~LCMSTransform() {
+    _gamutChecker = nullptr;
+    _transform = nullptr;
+    LCMSColorProfileRelease(_targetColorProfile);
+    LCMSColorProfileRelease(_sourceColorProfile);
+    LCMSContextRelease(_context);
+}
+
+
+LCMSTransform* fn_nullable LCMSTransform::create(LCMSColorProfile* fn_nullable sourceColorProfile,
+                                                 LCMSColorProfile* fn_nullable targetColorProfile,
+                                                 long inputNumComponents, long inputComponentSize,
+                                                 long outputNumComponents, long outputComponentSize,
+                                                 const LCMSConversionOptions& options,
+                                                 long expectedNumPixels,
+                                                 LCMSContext* fn_nullable context) {
+    if (validatePixelFormat(inputNumComponents, inputComponentSize) == false ||
+        validatePixelFormat(outputNumComponents, outputComponentSize) == false) {
+        return nullptr;
+    }
+    
+    context = lcmsContextOrDefault(context);
+    LCMSMemoryScope memory(context->getMemoryTracker(), LCMSMemoryCategory::lcms);
+    LCMSLogScope log(context);
+    auto contextHandle = context->getThreadHandle();
+    
+    auto inputFormat = ComponentConverter::calculate(inputNumComponents, inputComponentSize);
+    auto outputFormat = ComponentConverter::calculate(outputNumComponents, outputComponentSize);
+    
+    auto pairTraits = context->getProfilePairCache().get(sourceColorProfile, targetColorProfile, lcmsConversionIntent(options));
+    LCMSConversionTraits traits = {
+        .numPixels = expectedNumPixels,
+        .inputFormat = inputFormat,
+        .outputFormat = outputFormat,
+        .sourceIsMatrixShaper = pairTraits.sourceIsMatrixShaper,
+        .targetIsMatrixShaper = pairTraits.targetIsMatrixShaper,
+        .profileMatch = pairTraits.profileMatch
+    };
+    auto plan = lcmsPlanConversion(options, traits);
+    
+    cmsUInt32Number flags = 0;
+    if (lcmsConversionFlags(options, plan, flags) == false) {
+        return nullptr;
+    }
+    
+    LCMSTransformKey key = {
+        .sourceProfile = LCMSTransformKey::identify(sourceColorProfile),
+        .targetProfile = LCMSTransformKey::identify(targetColorProfile),
+        .inputFormat = inputFormat,
+        .outputFormat = outputFormat,
+        .intent = lcmsConversionIntent(options),
+        .flags = flags
+    };
+    auto transform = context->getTransformCache().get(key, [&]() -> LCMSTransformReference {
+        // Get source color profile
+        auto srcProfile = lcmsProfileHandle(sourceColorProfile);
+        if (srcProfile == nullptr) {
+            printf("Could not create source ICC profile\n");
+            return nullptr;
+        }
+        
+        // Get destination color profile
+        auto dstProfile = lcmsProfileHandle(targetColorProfile);
+        if (dstProfile == nullptr) {
+            printf("Could not create destination ICC profile\n");
+            return nullptr;
+        }
+        
+        // Profiles live in their own contexts, the transform is created in the one with the plugins
+        auto transform = cmsCreateTransformTHR(contextHandle,
+                                               srcProfile, key.inputFormat,
+                                               dstProfile, key.outputFormat,
+                                               key.intent,
+                                               key.flags);
+        if (transform == nullptr) {
+            return nullptr;
+        }
+        
+        return std::make_shared<LCMSCachedTransform>(transform, sourceColorProfile, targetColorProfile);
+    });
+    if (transform == nullptr) {
+        printf("Could not create color profile transform\n");
+        return nullptr;
+    }
+    
+    // Callers that don't need the gamut mask don't pay for its transforms
+    std::shared_ptr<LCMSGamutChecker> gamutChecker;
+    if (options.gamutCheck) {
+        gamutChecker = LCMSGamutChecker::create(context, transform, sourceColorProfile, targetColorProfile, inputFormat, key.intent, key.flags);
+        if (gamutChecker == nullptr) {
+            return nullptr;
+        }
+    }
+    
+    return new LCMSTransform(context, std::move(transform), std::move(gamutChecker),
+                             sourceColorProfile, targetColorProfile,
+                             inputNumComponents, inputComponentSize,
+                             outputNumComponents, outputComponentSize,
+                             options, plan);
+}
+
+
+LCMSTransform* fn_nullable LCMSTransform::create(LCMSColorProfile* fn_nullable sourceColorProfile,
+                                                 LCMSColorProfile* fn_nullable targetColorProfile,
+                                                 long numComponents, long componentSize,
+                                                 const LCMSConversionOptions& options,
+                                                 long expectedNumPixels,
+                                                 LCMSContext* fn_nullable context) {
+    return create(sourceColorProfile, targetColorProfile, numComponents, componentSize, numComponents, componentSize, options, expectedNumPixels, context);
+}
+
+
+void LCMSTransform::_transformLines(const char* fn_nonnull source, char* fn_nonnull destination, long width, long height, long sourceBytesPerRow, long destinationBytesPerRow, long numThreads) {
+    // Equivalent profiles and the same pixel format, the pixels stay as they are
+    if (_plan == LCMSConversionPlan::formatOnly && _inputNumComponents == _outputNumComponents && _inputComponentSize == _outputComponentSize) {
+        if (source != destination) {
+            auto rowSize = width * getInputPixelSize();
+            for (long y = 0; y < height; y++) {
+                memcpy(destination + y * destinationBytesPerRow, source + y * sourceBytesPerRow, rowSize);
+            }
+        }
+        return;
+    }
+    
+    LCMSTransformWorkersScope workers(numThreads);
+    
+    // Transform all rows with a single call, straight into the destination. The transform scheduler splits it into slices
+    cmsDoTransformLineStride(_transform->get(), source, destination,
+                             static_cast<cmsUInt32Number>(width), static_cast<cmsUInt32Number>(height),
+                             static_cast<cmsUInt32Number>(sourceBytesPerRow), static_cast<cmsUInt32Number>(destinationBytesPerRow),
+                             0, 0);
+}
+
+
+LCMSImage* fn_nullable LCMSTransform::apply(LCMSImage* fn_nonnull image, long numThreads) {
+    if (image->getNumComponents() != _inputNumComponents || image->getComponentSize() != _inputComponentSize) {
+        printf("Image pixel format doesn't match the transform's input pixel format\n");
+        return nullptr;
+    }
+    
+    LCMSConversionMemoryScope memory(_context->getMemoryTracker());
+    auto width = image->getWidth();
+    auto height = image->getHeight();
+    auto destinationBytesPerRow = width * _outputNumComponents * _outputComponentSize;
+    auto destination = new char[destinationBytesPerRow * height];
+    
+    _transformLines(image->getData(), destination,
+                    width, height,
+                    width * _inputNumComponents * _inputComponentSize, destinationBytesPerRow,
+                    numThreads);
+    
+    // The new image takes ownership of the pixel data
+    return new LCMSImage(destination, false, width, height, _outputNumComponents, _outputComponentSize, image->getIsHDR(), LCMSColorProfileRetain(_targetColorProfile), _context);
+}
+
+
+bool LCMSTransform::apply(const void* fn_nonnull source, void* fn_nonnull destination, long width, long height, long sourceBytesPerRow, long destinationBytesPerRow, long numThreads) {
+    if (width < 1 || height < 1) {
+        printf("Invalid size: %ldx%ld\n", width, height);
+        return false;
+    }
+    
+    if (sourceBytesPerRow == 0) {
+        sourceBytesPerRow = width * _inputNumComponents * _inputComponentSize;
+    }
+    
+    if (destinationBytesPerRow == 0) {
+        destinationBytesPerRow = width * _outputNumComponents * _outputComponentSize;
+    }
+    
+    // lcms reads every pixel before writing it, so in-place conversion works as long as pixels and rows don't move
+    if (source == destination && (getInputPixelSize() != getOutputPixelSize() || sourceBytesPerRow != destinationBytesPerRow)) {
+        printf("In-place transform requires equal input and output pixel sizes\n");
+        return false;
+    }
+    
+    LCMSConversionMemoryScope memory(_context->getMemoryTracker());
+    _transformLines(static_cast<const char*>(source), static_cast<char*>(destination), width, height, sourceBytesPerRow, destinationBytesPerRow, numThreads);
+    
+    return true;
+}
+
+
+bool LCMSTransform::applyWithGamutMask(const void* fn_nonnull source, void* fn_nonnull destination, void* fn_nonnull gamutMask, long width, long height, long sourceBytesPerRow, long destinationBytesPerRow, long gamutMaskBytesPerRow, long numThreads) {
+    if (_gamutChecker == nullptr) {
+        printf("Transform was created without the gamut check\n");
+        return false;
+    }
+    
+    if (width < 1 || height < 1) {
+        printf("Invalid size: %ldx%ld\n", width, height);
+        return false;
+    }
+    
+    if (sourceBytesPerRow == 0) {
+        sourceBytesPerRow = width * _inputNumComponents * _inputComponentSize;
+    }
+    
+    if (destinationBytesPerRow == 0) {
+        destinationBytesPerRow = width * _outputNumComponents * _outputComponentSize;
+    }
+    
+    auto format = _options.gamutMaskFormat;
+    if (gamutMaskBytesPerRow == 0) {
+        gamutMaskBytesPerRow = lcmsGamutMaskBytesPerRow(width, format);
+    }
+    
+    if (gamutMaskBytesPerRow < lcmsGamutMaskBytesPerRow(width, format)) {
+        printf("Gamut mask rows are too short: %ld bytes\n", gamutMaskBytesPerRow);
+        return false;
+    }
+    
+    if (source == destination && (getInputPixelSize() != getOutputPixelSize() || sourceBytesPerRow != destinationBytesPerRow)) {
+        printf("In-place transform requires equal input and output pixel sizes\n");
+        return false;
+    }
+    
+    // Bands run on other threads, their scratch rows are counted in the conversion explicitly
+    LCMSConversionMemoryScope memory(_context->getMemoryTracker());
+    auto memoryTracker = LCMSMemoryTracker::select(_context->getMemoryTracker());
+    
+    LCMSTransformWorkersScope workers(numThreads);
+    auto numWorkers = lcmsCurrentTransformWorkers(_context->getHandle());
+    auto numBands = std::clamp(width * height / minPixelsPerBand, 1l, std::min(numWorkers, height));
+    auto rowsPerBand = (height + numBands - 1) / numBands;
+    numBands = (height + rowsPerBand - 1) / rowsPerBand;
+    
+    // Bands are already parallel, rows inside of them are converted on the band's thread
+    LCMSThreadPool::shared().parallelFor(numBands, numWorkers, [&](long band) {
+        LCMSTransformWorkersScope single(1);
+        LCMSGamutScratch scratch;
+        LCMSTrackedMemory scratchMemory(memoryTracker, LCMSMemoryCategory::scratch, _gamutChecker->prepareScratch(width, scratch));
+        
+        auto firstRow = band * rowsPerBand;
+        auto lastRow = std::min(firstRow + rowsPerBand, height);
+        for (auto y = firstRow; y < lastRow; y++) {
+            _gamutChecker->convertRow(static_cast<const char*>(source) + y * sourceBytesPerRow,
+                                      static_cast<char*>(destination) + y * destinationBytesPerRow,
+                                      static_cast<unsigned char*>(gamutMask) + y * gamutMaskBytesPerRow,
+                                      width, format, scratch);
+        }
+    });
+    
+    return true;
+}
+
+
+bool LCMSTransform::applyRow(const void* fn_nonnull source, void* fn_nonnull destination, long numPixels) {
+    return apply(source, destination, numPixels, 1, 0, 0, 1);
+}
+
+
+void LCMSTransform::setMaxWorkers(long maxWorkers) {
+    LCMSContext::getDefault()->setMaxWorkers(maxWorkers);
+}
+
+
+long LCMSTransform::getMaxWorkers() {
+    return LCMSContext::getDefault()->getMaxWorkers();
+}
+
+
+//
+
+FN_IMPLEMENT_SWIFT_INTERFACE1(LCMSTransform)
@@ -0,0 +1,32 @@
+//
+//  LogScope.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+
+
+class LCMSContext;
+
+
+/// Reports errors of lcms contexts without an owner to the `context`'s log handler while the scope is alive on the calling thread.
+///
+/// Profiles are parsed in contexts that may outlive their `LCMSContext` inside another context's transform cache, so they can't point at it. Callers open the scope while they keep the `context` alive.
+class LCMSLogScope final {
+private:
+    LCMSContext* fn_nullable _previousContext;
+    
+public:
+    LCMSLogScope(LCMSContext* fn_nonnull context);
+    ~LCMSLogScope();
+    
+    LCMSLogScope(const LCMSLogScope&) = delete;
+    LCMSLogScope& operator=(const LCMSLogScope&) = delete;
+    
+    /// Context of the innermost scope on the calling thread, `nullptr` if there's none.
+    static LCMSContext* fn_nullable current();
+};
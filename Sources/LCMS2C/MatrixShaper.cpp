@@ -0,0 +1,583 @@
+//
+//  MatrixShaper.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "MatrixShaper.hpp"
+#include "Half.hpp"
+#include "GamutCheck.hpp"
+#include "MemoryTracker.hpp"
+#include <lcms2_plugin.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#define LCMS_MATRIX_SSE2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define LCMS_MATRIX_NEON 1
+#endif
+
+
+/// Intervals of the curve lookup tables over `[0, 1]`.
+static constexpr long curveTableSize = 4096;
+
+/// Maximum difference of an interpolated curve value from the exact one.
+static constexpr float maxCurveError = 1.0f / 32768;
+
+/// Pixels processed at once. Keeps the scratch buffers on the stack and in L1. A multiple of 8, so that blocks start at a byte of a 1-bit gamut mask.
+static constexpr long pixelsPerBlock = 256;
+
+/// Pixels per vector. Blocks are padded to a multiple of it, so that every pixel goes through the same instructions wherever a row is split into slices.
+static constexpr long pixelsPerVector = 4;
+
+/// How far linear target values may leave `[0, 1]` before a colour counts as out of gamut. Covers float rounding of the matrix.
+static constexpr float gamutEpsilon = 1.0f / 4096;
+
+
+/// Applies the affine `matrix` and `offset` to `count` pixels of planar RGB `channels`. `count` has to be a multiple of ``pixelsPerVector``.
+///
+/// Multiplications and additions are rounded separately in the same order on every CPU, nothing is fused.
+static void applyMatrix(const float* fn_nonnull matrix, const float* fn_nonnull offset, float (* fn_nonnull channels)[pixelsPerBlock], long count) {
+#if LCMS_MATRIX_SSE2
+    __m128 m[9];
+    __m128 o[3];
+    for (int i = 0; i < 9; i++) {
+        m[i] = _mm_set1_ps(matrix[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        o[i] = _mm_set1_ps(offset[i]);
+    }
+    
+    for (long i = 0; i < count; i += pixelsPerVector) {
+        auto r = _mm_loadu_ps(channels[0] + i);
+        auto g = _mm_loadu_ps(channels[1] + i);
+        auto b = _mm_loadu_ps(channels[2] + i);
+        for (int c = 0; c < 3; c++) {
+            auto value = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[c * 3], r), _mm_mul_ps(m[c * 3 + 1], g)), _mm_mul_ps(m[c * 3 + 2], b)), o[c]);
+            _mm_storeu_ps(channels[c] + i, value);
+        }
+    }
+#elif LCMS_MATRIX_NEON
+    float32x4_t m[9];
+    float32x4_t o[3];
+    for (int i = 0; i < 9; i++) {
+        m[i] = vdupq_n_f32(matrix[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        o[i] = vdupq_n_f32(offset[i]);
+    }
+    
+    for (long i = 0; i < count; i += pixelsPerVector) {
+        auto r = vld1q_f32(channels[0] + i);
+        auto g = vld1q_f32(channels[1] + i);
+        auto b = vld1q_f32(channels[2] + i);
+        for (int c = 0; c < 3; c++) {
+            auto value = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(m[c * 3], r), vmulq_f32(m[c * 3 + 1], g)), vmulq_f32(m[c * 3 + 2], b)), o[c]);
+            vst1q_f32(channels[c] + i, value);
+        }
+    }
+#else
+    for (long i = 0; i < count; i++) {
+        float rgb[3] = { channels[0][i], channels[1][i], channels[2][i] };
+        for (int c = 0; c < 3; c++) {
+            float r = matrix[c * 3] * rgb[0];
+            float g = matrix[c * 3 + 1] * rgb[1];
+            float b = matrix[c * 3 + 2] * rgb[2];
+            float value = r + g;
+            value += b;
+            value += offset[c];
+            channels[c][i] = value;
+        }
+    }
+#endif
+}
+
+
+/// Sets `outOfGamut` to `1` for each of `count` pixels of planar RGB `channels` with a value outside `[0, 1]`, and to `0` otherwise. `count` has to be a multiple of ``pixelsPerVector``.
+///
+/// NaNs count as in gamut.
+static void testGamut(const float (* fn_nonnull channels)[pixelsPerBlock], long count, unsigned char* fn_nonnull outOfGamut) {
+#if LCMS_MATRIX_SSE2
+    auto low = _mm_set1_ps(-gamutEpsilon);
+    auto high = _mm_set1_ps(1 + gamutEpsilon);
+    for (long i = 0; i < count; i += pixelsPerVector) {
+        auto outside = _mm_setzero_ps();
+        for (int c = 0; c < 3; c++) {
+            auto value = _mm_loadu_ps(channels[c] + i);
+            outside = _mm_or_ps(outside, _mm_or_ps(_mm_cmplt_ps(value, low), _mm_cmpgt_ps(value, high)));
+        }
+        
+        auto bits = _mm_movemask_ps(outside);
+        for (long k = 0; k < pixelsPerVector; k++) {
+            outOfGamut[i + k] = (bits >> k) & 1;
+        }
+    }
+#elif LCMS_MATRIX_NEON
+    auto low = vdupq_n_f32(-gamutEpsilon);
+    auto high = vdupq_n_f32(1 + gamutEpsilon);
+    for (long i = 0; i < count; i += pixelsPerVector) {
+        auto outside = vdupq_n_u32(0);
+        for (int c = 0; c < 3; c++) {
+            auto value = vld1q_f32(channels[c] + i);
+            outside = vorrq_u32(outside, vorrq_u32(vcltq_f32(value, low), vcgtq_f32(value, high)));
+        }
+        
+        // All-ones lanes to one byte of 1 per pixel
+        auto halfs = vmovn_u32(vshrq_n_u32(outside, 31));
+        auto bytes = vmovn_u16(vcombine_u16(halfs, halfs));
+        auto packed = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+        memcpy(outOfGamut + i, &packed, sizeof(packed));
+    }
+#else
+    for (long i = 0; i < count; i++) {
+        auto r = channels[0][i];
+        auto g = channels[1][i];
+        auto b = channels[2][i];
+        outOfGamut[i] = (r < -gamutEpsilon) | (r > 1 + gamutEpsilon) |
+                        (g < -gamutEpsilon) | (g > 1 + gamutEpsilon) |
+                        (b < -gamutEpsilon) | (b > 1 + gamutEpsilon);
+    }
+#endif
+}
+
+
+/// Per-channel operations lcms applies one after another, folded into a single lookup table.
+class ChannelChain final {
+private:
+    /// `nullptr` stands for clipping negative values.
+    std::vector<const cmsToneCurve*> _operations;
+    std::vector<float> _table;
+    
+    /// Intervals that are evaluated exactly because interpolation isn't accurate enough.
+    std::vector<bool> _exact;
+    bool _identity = true;
+    
+    float _evaluateExact(float value) const {
+        for (auto curve: _operations) {
+            if (curve) {
+                value = cmsEvalToneCurveFloat(curve, value);
+            }
+            else {
+                value = std::max(value, 0.0f);
+            }
+        }
+        return value;
+    }
+    
+    bool _checkIsIdentity() const {
+        for (auto curve: _operations) {
+            // Only the parametric gamma keeps values outside [0, 1]
+            if (curve == nullptr || cmsGetToneCurveParametricType(curve) != 1) {
+                return false;
+            }
+        }
+        
+        for (auto value: { -0.5f, 0.0f, 0.2f, 0.5f, 1.0f, 4.0f }) {
+            if (_evaluateExact(value) != value) {
+                return false;
+            }
+        }
+        
+        return true;
+    }
+    
+public:
+    /// Bytes allocated for the operations and tables.
+    long getMemorySize() const {
+        return static_cast<long>(_operations.capacity() * sizeof(const cmsToneCurve*) + _table.capacity() * sizeof(float) + _exact.capacity() / 8);
+    }
+    
+    void appendCurve(const cmsToneCurve* fn_nonnull curve) { _operations.push_back(curve); }
+    void appendClip() { _operations.push_back(nullptr); }
+    
+    void prepare() {
+        _identity = _operations.empty() || _checkIsIdentity();
+        if (_identity) {
+            return;
+        }
+        
+        _table.resize(curveTableSize + 1);
+        for (long i = 0; i <= curveTableSize; i++) {
+            _table[i] = _evaluateExact(static_cast<float>(i) / curveTableSize);
+        }
+        
+        _exact.resize(curveTableSize);
+        for (long i = 0; i < curveTableSize; i++) {
+            for (auto t: { 0.25f, 0.5f, 0.75f }) {
+                auto interpolated = _table[i] + t * (_table[i + 1] - _table[i]);
+                auto exact = _evaluateExact((i + t) / curveTableSize);
+                if (std::abs(interpolated - exact) > maxCurveError) {
+                    _exact[i] = true;
+                    break;
+                }
+            }
+        }
+    }
+    
+    void apply(float* fn_nonnull values, long count) const {
+        if (_identity) {
+            return;
+        }
+        
+        for (long i = 0; i < count; i++) {
+            auto value = values[i];
+            
+            // NaNs fail the range check and go to lcms as well
+            if (value >= 0 && value <= 1) {
+                auto position = value * curveTableSize;
+                auto index = std::min(static_cast<long>(position), curveTableSize - 1);
+                if (_exact[index] == false) {
+                    auto t = position - index;
+                    values[i] = _table[index] + t * (_table[index + 1] - _table[index]);
+                    continue;
+                }
+            }
+            
+            values[i] = _evaluateExact(value);
+        }
+    }
+};
+
+
+/// Interleaved RGB pixel layout with an optional extra channel, in float or half float.
+struct PixelLayout {
+    long componentSize;
+    long numComponents;
+    
+    /// Returns `false` for formats the fast path doesn't handle.
+    bool parse(cmsUInt32Number format) {
+        if (T_FLOAT(format) == 0 || T_CHANNELS(format) != 3 || T_EXTRA(format) > 1 ||
+            T_PLANAR(format) || T_DOSWAP(format) || T_SWAPFIRST(format) ||
+            T_FLAVOR(format) || T_ENDIAN16(format) || T_PREMUL(format)) {
+            return false;
+        }
+        
+        if (T_BYTES(format) != 2 && T_BYTES(format) != 4) {
+            return false;
+        }
+        
+        componentSize = T_BYTES(format);
+        numComponents = T_CHANNELS(format) + T_EXTRA(format);
+        return true;
+    }
+    
+    void load(const cmsUInt8Number* fn_nonnull source, float* fn_nonnull destination, long numPixels) const {
+        if (componentSize == 2) {
+            lcmsHalfToFloat(reinterpret_cast<const LCMSHalf*>(source), destination, numPixels * numComponents);
+        }
+        else {
+            memcpy(destination, source, numPixels * numComponents * sizeof(float));
+        }
+    }
+    
+    void store(const float* fn_nonnull source, cmsUInt8Number* fn_nonnull destination, long numPixels) const {
+        if (componentSize == 2) {
+            lcmsFloatToHalf(source, reinterpret_cast<LCMSHalf*>(destination), numPixels * numComponents);
+        }
+        else {
+            memcpy(destination, source, numPixels * numComponents * sizeof(float));
+        }
+    }
+};
+
+
+/// Curves, affine matrix and curves of a matrix-shaper transform.
+class MatrixShaperKernel final {
+private:
+    ChannelChain _inputCurves[3];
+    float _matrix[9];
+    float _offset[3];
+    ChannelChain _outputCurves[3];
+    
+    PixelLayout _input;
+    PixelLayout _output;
+    bool _copyAlpha;
+    
+    /// The kernel is allocated outside of lcms, so it's counted separately.
+    LCMSTrackedMemory _memory;
+    
+    MatrixShaperKernel(): _matrix { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, _offset { 0, 0, 0 } { }
+    
+    /// Loads a block of pixels and takes it through the input curves and the matrix, into linear target values.
+    void _linearize(const cmsUInt8Number* fn_nonnull input, float* fn_nonnull inputPixels, float (* fn_nonnull channels)[pixelsPerBlock], long count) const {
+        _input.load(input, inputPixels, count);
+        for (long i = 0; i < count; i++) {
+            for (int c = 0; c < 3; c++) {
+                channels[c][i] = inputPixels[i * _input.numComponents + c];
+            }
+        }
+        
+        for (int c = 0; c < 3; c++) {
+            _inputCurves[c].apply(channels[c], count);
+        }
+        
+        // Padding pixels are transformed too, but never stored
+        auto paddedCount = _paddedCount(count);
+        for (int c = 0; c < 3; c++) {
+            std::fill(channels[c] + count, channels[c] + paddedCount, 0.0f);
+        }
+        applyMatrix(_matrix, _offset, channels, paddedCount);
+    }
+    
+    static long _paddedCount(long count) {
+        return (count + pixelsPerVector - 1) / pixelsPerVector * pixelsPerVector;
+    }
+    
+    /// A target colour is out of gamut exactly when one of its linear values is outside `[0, 1]`.
+    static void _testGamut(const float (* fn_nonnull channels)[pixelsPerBlock], long count, unsigned char* fn_nonnull outOfGamut) {
+        testGamut(channels, _paddedCount(count), outOfGamut);
+    }
+    
+public:
+    /// Returns `nullptr` if the pipeline or the pixel formats don't fit the fast path.
+    static MatrixShaperKernel* fn_nullable create(const cmsPipeline* fn_nonnull lut, cmsUInt32Number inputFormat, cmsUInt32Number outputFormat, cmsUInt32Number flags) {
+        if (cmsPipelineInputChannels(lut) != 3 || cmsPipelineOutputChannels(lut) != 3) {
+            return nullptr;
+        }
+        
+        PixelLayout input;
+        PixelLayout output;
+        if (input.parse(inputFormat) == false || output.parse(outputFormat) == false) {
+            return nullptr;
+        }
+        
+        auto kernel = new MatrixShaperKernel();
+        kernel->_input = input;
+        kernel->_output = output;
+        kernel->_copyAlpha = (flags & cmsFLAGS_COPY_ALPHA) && input.numComponents == 4 && output.numComponents == 4;
+        
+        // Matrices are composed in double like lcms does
+        double matrix[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+        double offset[3] = { 0, 0, 0 };
+        
+        enum { inputCurves, affine, outputCurves } section = inputCurves;
+        for (auto stage = cmsPipelineGetPtrToFirstStage(lut); stage; stage = cmsStageNext(stage)) {
+            auto curves = section == inputCurves ? kernel->_inputCurves : kernel->_outputCurves;
+            
+            switch (cmsStageType(stage)) {
+                case cmsSigIdentityElemType:
+                    break;
+                    
+                case cmsSigCurveSetElemType: {
+                    auto data = static_cast<const _cmsStageToneCurvesData*>(cmsStageData(stage));
+                    if (data->nCurves != 3) {
+                        delete kernel;
+                        return nullptr;
+                    }
+                    
+                    if (section == affine) {
+                        section = outputCurves;
+                        curves = kernel->_outputCurves;
+                    }
+                    for (int c = 0; c < 3; c++) {
+                        curves[c].appendCurve(data->TheCurves[c]);
+                    }
+                    break;
+                }
+                    
+                case cmsSigClipNegativesElemType:
+                    if (section == affine) {
+                        section = outputCurves;
+                        curves = kernel->_outputCurves;
+                    }
+                    for (int c = 0; c < 3; c++) {
+                        curves[c].appendClip();
+                    }
+                    break;
+                    
+                case cmsSigMatrixElemType: {
+                    // A second matrix block after curves is not a matrix-shaper pipeline
+                    if (section == outputCurves || cmsStageInputChannels(stage) != 3 || cmsStageOutputChannels(stage) != 3) {
+                        delete kernel;
+                        return nullptr;
+                    }
+                    section = affine;
+                    
+                    auto data = static_cast<const _cmsStageMatrixData*>(cmsStageData(stage));
+                    double composed[9];
+                    double composedOffset[3];
+                    for (int i = 0; i < 3; i++) {
+                        for (int j = 0; j < 3; j++) {
+                            composed[i * 3 + j] = 0;
+                            for (int k = 0; k < 3; k++) {
+                                composed[i * 3 + j] += data->Double[i * 3 + k] * matrix[k * 3 + j];
+                            }
+                        }
+                        
+                        composedOffset[i] = data->Offset ? data->Offset[i] : 0;
+                        for (int k = 0; k < 3; k++) {
+                            composedOffset[i] += data->Double[i * 3 + k] * offset[k];
+                        }
+                    }
+                    memcpy(matrix, composed, sizeof(matrix));
+                    memcpy(offset, composedOffset, sizeof(offset));
+                    break;
+                }
+                    
+                default:
+                    delete kernel;
+                    return nullptr;
+            }
+        }
+        
+        for (int i = 0; i < 9; i++) {
+            kernel->_matrix[i] = static_cast<float>(matrix[i]);
+        }
+        for (int i = 0; i < 3; i++) {
+            kernel->_offset[i] = static_cast<float>(offset[i]);
+        }
+        
+        auto memorySize = static_cast<long>(sizeof(MatrixShaperKernel));
+        for (int c = 0; c < 3; c++) {
+            kernel->_inputCurves[c].prepare();
+            kernel->_outputCurves[c].prepare();
+            memorySize += kernel->_inputCurves[c].getMemorySize() + kernel->_outputCurves[c].getMemorySize();
+        }
+        kernel->_memory = LCMSTrackedMemory(LCMSMemoryTracker::current(), LCMSMemoryCategory::lcms, memorySize);
+        
+        return kernel;
+    }
+    
+    /// Transforms a row of pixels. If a `gamutMask` is specified, it's filled from the linear target values of the same pass.
+    void transformLine(const cmsUInt8Number* fn_nonnull source, cmsUInt8Number* fn_nonnull destination, long numPixels,
+                       unsigned char* fn_nullable gamutMask = nullptr, LCMSGamutMaskFormat gamutMaskFormat = LCMSGamutMaskFormat::byte) const {
+        float inputPixels[pixelsPerBlock * 4];
+        float outputPixels[pixelsPerBlock * 4];
+        float channels[3][pixelsPerBlock];
+        unsigned char outOfGamut[pixelsPerBlock];
+        
+        auto inputPixelSize = _input.componentSize * _input.numComponents;
+        auto outputPixelSize = _output.componentSize * _output.numComponents;
+        
+        for (long first = 0; first < numPixels; first += pixelsPerBlock) {
+            auto count = std::min(pixelsPerBlock, numPixels - first);
+            auto input = source + first * inputPixelSize;
+            auto output = destination + first * outputPixelSize;
+            
+            _linearize(input, inputPixels, channels, count);
+            
+            if (gamutMask) {
+                _testGamut(channels, count, outOfGamut);
+                lcmsStoreGamutMask(outOfGamut, first, count, gamutMask, gamutMaskFormat);
+            }
+            
+            for (int c = 0; c < 3; c++) {
+                _outputCurves[c].apply(channels[c], count);
+            }
+            
+            // Extra channels that aren't copied keep their values, and half floats survive a round trip through float
+            if (_output.numComponents == 4) {
+                if (_copyAlpha) {
+                    for (long i = 0; i < count; i++) {
+                        outputPixels[i * 4 + 3] = inputPixels[i * 4 + 3];
+                    }
+                }
+                else {
+                    _output.load(output, outputPixels, count);
+                }
+            }
+            
+            for (long i = 0; i < count; i++) {
+                for (int c = 0; c < 3; c++) {
+                    outputPixels[i * _output.numComponents + c] = channels[c][i];
+                }
+            }
+            _output.store(outputPixels, output, count);
+        }
+    }
+    
+    /// Fills the `gamutMask` of a row of pixels without transforming them.
+    void checkGamutLine(const cmsUInt8Number* fn_nonnull source, long numPixels, unsigned char* fn_nonnull gamutMask, LCMSGamutMaskFormat gamutMaskFormat) const {
+        float inputPixels[pixelsPerBlock * 4];
+        float channels[3][pixelsPerBlock];
+        unsigned char outOfGamut[pixelsPerBlock];
+        
+        auto inputPixelSize = _input.componentSize * _input.numComponents;
+        for (long first = 0; first < numPixels; first += pixelsPerBlock) {
+            auto count = std::min(pixelsPerBlock, numPixels - first);
+            _linearize(source + first * inputPixelSize, inputPixels, channels, count);
+            _testGamut(channels, count, outOfGamut);
+            lcmsStoreGamutMask(outOfGamut, first, count, gamutMask, gamutMaskFormat);
+        }
+    }
+};
+
+
+static void transformMatrixShaper(struct _cmstransform_struct* CMMcargo,
+                                  const void* InputBuffer,
+                                  void* OutputBuffer,
+                                  cmsUInt32Number PixelsPerLine,
+                                  cmsUInt32Number LineCount,
+                                  const cmsStride* Stride) {
+    auto kernel = static_cast<const MatrixShaperKernel*>(_cmsGetTransformUserData(CMMcargo));
+    for (cmsUInt32Number y = 0; y < LineCount; y++) {
+        kernel->transformLine(static_cast<const cmsUInt8Number*>(InputBuffer) + y * Stride->BytesPerLineIn,
+                              static_cast<cmsUInt8Number*>(OutputBuffer) + y * Stride->BytesPerLineOut,
+                              PixelsPerLine);
+    }
+}
+
+
+static cmsBool matrixShaperFactory(_cmsTransform2Fn* xform,
+                                   void** UserData,
+                                   _cmsFreeUserDataFn* FreePrivateDataFn,
+                                   cmsPipeline** Lut,
+                                   cmsUInt32Number* InputFormat,
+                                   cmsUInt32Number* OutputFormat,
+                                   cmsUInt32Number* dwFlags) {
+    auto kernel = MatrixShaperKernel::create(*Lut, *InputFormat, *OutputFormat, *dwFlags);
+    if (kernel == nullptr) {
+        return false;
+    }
+    
+    // The curves are owned by the pipeline, which lcms keeps for the transform's lifetime
+    *xform = transformMatrixShaper;
+    *UserData = kernel;
+    *FreePrivateDataFn = [](cmsContext ContextID, void* Data) {
+        delete static_cast<MatrixShaperKernel*>(Data);
+    };
+    return true;
+}
+
+
+const MatrixShaperKernel* fn_nullable lcmsMatrixShaperKernel(cmsHTRANSFORM fn_nonnull transform) {
+    // The scheduler keeps the transform function as the worker
+    if (_cmsGetTransformWorker(static_cast<struct _cmstransform_struct*>(transform)) != transformMatrixShaper) {
+        return nullptr;
+    }
+    
+    return static_cast<const MatrixShaperKernel*>(_cmsGetTransformUserData(static_cast<struct _cmstransform_struct*>(transform)));
+}
+
+
+void lcmsMatrixShaperTransformRow(const MatrixShaperKernel& kernel, const void* fn_nonnull source, void* fn_nonnull destination, long numPixels, unsigned char* fn_nullable gamutMask, LCMSGamutMaskFormat gamutMaskFormat) {
+    kernel.transformLine(static_cast<const cmsUInt8Number*>(source), static_cast<cmsUInt8Number*>(destination), numPixels, gamutMask, gamutMaskFormat);
+}
+
+
+void lcmsMatrixShaperCheckGamutRow(const MatrixShaperKernel& kernel, const void* fn_nonnull source, long numPixels, unsigned char* fn_nonnull gamutMask, LCMSGamutMaskFormat gamutMaskFormat) {
+    kernel.checkGamutLine(static_cast<const cmsUInt8Number*>(source), numPixels, gamutMask, gamutMaskFormat);
+}
+
+
+bool lcmsInstallMatrixShaperTransforms(cmsContext fn_nonnull context) {
+    static cmsPluginTransform plugin = {
+        .base = {
+            .Magic = cmsPluginMagicNumber,
+            .ExpectedVersion = LCMS_VERSION,
+            .Type = cmsPluginTransformSig,
+            .Next = nullptr
+        },
+        .factories = {
+            .xform = matrixShaperFactory
+        }
+    };
+    
+    return cmsPluginTHR(context, &plugin);
+}
@@ -0,0 +1,41 @@
+//
+//  MatrixShaper.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <LCMS2C/ConversionOptions.hpp>
+#include <lcms2.h>
+
+
+class MatrixShaperKernel;
+
+
+/// Installs the matrix-shaper fast path as lcms transform plugin into the `context`.
+///
+/// It takes over float and half float RGB transforms whose pipeline is made of per-channel curves, a single affine matrix block and per-channel curves again, which is every transform between matrix-shaper profiles. Pixels are processed in blocks: curves are evaluated value by value through lookup tables, the matrix and the gamut test four pixels at a time with SSE2 on x86-64 and NEON on ARM.
+///
+/// Accuracy of the stages: inside `[0, 1]` every interpolated curve value is within 2^-15 of lcms's own evaluation; intervals where linear interpolation can't guarantee that are evaluated exactly. Values outside `[0, 1]` are always evaluated exactly, so unbounded HDR values come out the same as with lcms. The matrix is applied in float.
+///
+/// End to end, compared to the same transform built with `cmsFLAGS_NOOPTIMIZE`, for inputs in `[0, 1]` between the built-in profiles: outputs of at least 1/64 are within 2^-14. Darker outputs are within 2^-9, because steep output curves like the 1/2.6 gamma of DCI-P3 amplify the curve error of colours whose linear value cancels out to almost zero. Measured maxima are 2^-15.1 and 2^-10.6.
+///
+/// - Note: lcms only offers transform plugins to transforms created without `cmsFLAGS_NOOPTIMIZE`.
+bool lcmsInstallMatrixShaperTransforms(cmsContext fn_nonnull context);
+
+
+/// Fast path kernel of a `transform` created in a context with the fast path installed, or `nullptr` if lcms evaluates the transform itself.
+const MatrixShaperKernel* fn_nullable lcmsMatrixShaperKernel(cmsHTRANSFORM fn_nonnull transform);
+
+
+/// Transforms a row of pixels like the kernel's transform does.
+///
+/// If a `gamutMask` is specified, it's filled in the same pass: a colour is out of the target's gamut exactly when one of its linear target values, right after the matrix, is outside `[0, 1]`.
+void lcmsMatrixShaperTransformRow(const MatrixShaperKernel& kernel, const void* fn_nonnull source, void* fn_nonnull destination, long numPixels, unsigned char* fn_nullable gamutMask, LCMSGamutMaskFormat gamutMaskFormat);
+
+
+/// Fills the `gamutMask` of a row of pixels the same way without transforming them.
+void lcmsMatrixShaperCheckGamutRow(const MatrixShaperKernel& kernel, const void* fn_nonnull source, long numPixels, unsigned char* fn_nonnull gamutMask, LCMSGamutMaskFormat gamutMaskFormat);
@@ -0,0 +1,331 @@
+//
+//  MemoryPool.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "MemoryPool.hpp"
+#include "MemoryTracker.hpp"
+#include <lcms2_plugin.h>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+
+/// Same limit as lcms's default allocator.
+static constexpr size_t maxAllocationSize = 512 * 1024 * 1024;
+
+static constexpr size_t sizeClasses[] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096 };
+static constexpr uint32_t numSizeClasses = sizeof(sizeClasses) / sizeof(sizeClasses[0]);
+
+/// Size class of blocks from the system allocator.
+static constexpr uint32_t largeSizeClass = numSizeClasses;
+
+static constexpr size_t slabSize = 64 * 1024;
+
+/// Blocks a thread keeps per size class before it gives half of them back.
+static constexpr long maxCachedBlocks = 64;
+
+
+/// Precedes every block. Keeps the returned memory 16-byte aligned.
+struct alignas(16) BlockHeader {
+    uint8_t sizeClass;
+    uint8_t category;
+    uint16_t reserved;
+    uint32_t size;
+    
+    /// Tracker the block is counted in.
+    LCMSMemoryTracker* fn_nullable tracker;
+};
+
+
+struct FreeBlock {
+    FreeBlock* fn_nullable next;
+};
+
+
+/// Process-wide free list of a size class.
+struct SizeClassPool {
+    std::mutex mutex;
+    FreeBlock* fn_nullable freeBlocks = nullptr;
+    char* fn_nullable slab = nullptr;
+    size_t slabRemaining = 0;
+};
+
+
+static SizeClassPool* fn_nonnull sizeClassPools() {
+    // Intentionally leaked, lcms frees memory during static destruction
+    static auto pools = new SizeClassPool[numSizeClasses];
+    return pools;
+}
+
+
+static uint32_t sizeClassOf(size_t size) {
+    for (uint32_t i = 0; i < numSizeClasses; i++) {
+        if (size <= sizeClasses[i]) {
+            return i;
+        }
+    }
+    return largeSizeClass;
+}
+
+
+/// Per-thread free lists, handed back to the process-wide ones when the thread ends.
+struct ThreadCache {
+    FreeBlock* fn_nullable freeBlocks[numSizeClasses] = { };
+    long numFreeBlocks[numSizeClasses] = { };
+    
+    ~ThreadCache();
+};
+
+
+enum class ThreadCacheState: uint8_t {
+    unused = 0,
+    alive,
+    destroyed
+};
+
+
+/// Trivially destructible, so it can still be read after the cache is gone during thread exit.
+static thread_local ThreadCacheState threadCacheState = ThreadCacheState::unused;
+static thread_local ThreadCache threadCache;
+
+
+/// Moves `count` blocks from the front of the `list` into the pool of the `sizeClass`.
+static void returnBlocks(uint32_t sizeClass, FreeBlock* fn_nullable& list, long count) {
+    if (list == nullptr || count < 1) {
+        return;
+    }
+    
+    auto first = list;
+    auto last = first;
+    for (long i = 1; i < count && last->next; i++) {
+        last = last->next;
+    }
+    list = last->next;
+    
+    auto& pool = sizeClassPools()[sizeClass];
+    std::lock_guard lock(pool.mutex);
+    last->next = pool.freeBlocks;
+    pool.freeBlocks = first;
+}
+
+
+ThreadCache::~ThreadCache() {
+    threadCacheState = ThreadCacheState::destroyed;
+    for (uint32_t i = 0; i < numSizeClasses; i++) {
+        returnBlocks(i, freeBlocks[i], numFreeBlocks[i]);
+        numFreeBlocks[i] = 0;
+    }
+}
+
+
+/// Takes up to `count` blocks from the pool of the `sizeClass`, carving a new slab if it's empty.
+static FreeBlock* fn_nullable takeBlocks(uint32_t sizeClass, long count, long& numTaken) {
+    auto& pool = sizeClassPools()[sizeClass];
+    auto blockSize = sizeof(BlockHeader) + sizeClasses[sizeClass];
+    
+    std::lock_guard lock(pool.mutex);
+    FreeBlock* list = nullptr;
+    numTaken = 0;
+    while (numTaken < count) {
+        if (pool.freeBlocks) {
+            auto block = pool.freeBlocks;
+            pool.freeBlocks = block->next;
+            block->next = list;
+            list = block;
+            numTaken++;
+            continue;
+        }
+        
+        if (pool.slabRemaining < blockSize) {
+            // The rest of the old slab is too small to be useful
+            pool.slab = static_cast<char*>(malloc(slabSize));
+            pool.slabRemaining = pool.slab ? slabSize : 0;
+            if (pool.slab == nullptr) {
+                break;
+            }
+        }
+        
+        auto block = reinterpret_cast<FreeBlock*>(pool.slab);
+        pool.slab += blockSize;
+        pool.slabRemaining -= blockSize;
+        block->next = list;
+        list = block;
+        numTaken++;
+    }
+    
+    return list;
+}
+
+
+static BlockHeader* fn_nullable allocateBlock(uint32_t sizeClass) {
+    if (threadCacheState == ThreadCacheState::unused) {
+        // The first access constructs the cache
+        threadCache.numFreeBlocks[sizeClass] = 0;
+        threadCacheState = ThreadCacheState::alive;
+    }
+    
+    if (threadCacheState == ThreadCacheState::alive) {
+        auto& list = threadCache.freeBlocks[sizeClass];
+        if (list == nullptr) {
+            long numTaken = 0;
+            list = takeBlocks(sizeClass, maxCachedBlocks / 2, numTaken);
+            threadCache.numFreeBlocks[sizeClass] = numTaken;
+            if (list == nullptr) {
+                return nullptr;
+            }
+        }
+        
+        auto block = list;
+        list = block->next;
+        threadCache.numFreeBlocks[sizeClass]--;
+        return reinterpret_cast<BlockHeader*>(block);
+    }
+    
+    long numTaken = 0;
+    return reinterpret_cast<BlockHeader*>(takeBlocks(sizeClass, 1, numTaken));
+}
+
+
+static void freeBlock(BlockHeader* fn_nonnull header) {
+    auto sizeClass = header->sizeClass;
+    auto block = reinterpret_cast<FreeBlock*>(header);
+    
+    if (threadCacheState == ThreadCacheState::alive) {
+        auto& list = threadCache.freeBlocks[sizeClass];
+        block->next = list;
+        list = block;
+        
+        auto& count = threadCache.numFreeBlocks[sizeClass];
+        count++;
+        if (count > maxCachedBlocks) {
+            returnBlocks(sizeClass, list, maxCachedBlocks / 2);
+            count -= maxCachedBlocks / 2;
+        }
+        return;
+    }
+    
+    block->next = nullptr;
+    returnBlocks(sizeClass, block, 1);
+}
+
+
+/// Allocates a block from the pools if `pooled` is set, otherwise from the system allocator, and counts it in the calling thread's tracker.
+template<bool pooled>
+static void* trackedMalloc(cmsContext ContextID, cmsUInt32Number size) {
+    if (size > maxAllocationSize) {
+        return nullptr;
+    }
+    
+    auto sizeClass = pooled ? sizeClassOf(size) : largeSizeClass;
+    auto header = sizeClass == largeSizeClass ? static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + size)) : allocateBlock(sizeClass);
+    if (header == nullptr) {
+        return nullptr;
+    }
+    
+    auto category = LCMSMemoryTracker::currentCategory();
+    header->sizeClass = static_cast<uint8_t>(sizeClass);
+    header->category = static_cast<uint8_t>(category);
+    header->size = size;
+    header->tracker = LCMSMemoryTracker::current();
+    if (header->tracker) {
+        header->tracker->allocate(category, size);
+    }
+    return header + 1;
+}
+
+
+static void trackedFree(cmsContext ContextID, void* Ptr) {
+    if (Ptr == nullptr) {
+        return;
+    }
+    
+    auto header = static_cast<BlockHeader*>(Ptr) - 1;
+    if (header->tracker) {
+        header->tracker->deallocate(static_cast<LCMSMemoryCategory>(header->category), header->size);
+    }
+    
+    if (header->sizeClass == largeSizeClass) {
+        free(header);
+        return;
+    }
+    
+    freeBlock(header);
+}
+
+
+template<bool pooled>
+static void* trackedRealloc(cmsContext ContextID, void* Ptr, cmsUInt32Number NewSize) {
+    if (Ptr == nullptr) {
+        return trackedMalloc<pooled>(ContextID, NewSize);
+    }
+    
+    if (NewSize > maxAllocationSize) {
+        return nullptr;
+    }
+    
+    auto header = static_cast<BlockHeader*>(Ptr) - 1;
+    auto oldSize = header->size;
+    auto category = static_cast<LCMSMemoryCategory>(header->category);
+    
+    // Still fits
+    if (header->sizeClass != largeSizeClass && NewSize <= sizeClasses[header->sizeClass]) {
+        header->size = NewSize;
+    }
+    // Blocks of the system allocator can be resized by it
+    else if (header->sizeClass == largeSizeClass && (pooled == false || sizeClassOf(NewSize) == largeSizeClass)) {
+        auto resized = static_cast<BlockHeader*>(realloc(header, sizeof(BlockHeader) + NewSize));
+        if (resized == nullptr) {
+            return nullptr;
+        }
+        header = resized;
+        header->size = NewSize;
+    }
+    else {
+        auto copy = trackedMalloc<pooled>(ContextID, NewSize);
+        if (copy == nullptr) {
+            return nullptr;
+        }
+        
+        memcpy(copy, Ptr, std::min<size_t>(oldSize, NewSize));
+        trackedFree(ContextID, Ptr);
+        return copy;
+    }
+    
+    if (header->tracker) {
+        header->tracker->resize(category, oldSize, NewSize);
+    }
+    return header + 1;
+}
+
+
+/// Zeroing, calloc and dup are built on top of malloc by lcms.
+template<bool pooled>
+static cmsPluginMemHandler memoryHandler = {
+    .base = {
+        .Magic = cmsPluginMagicNumber,
+        .ExpectedVersion = LCMS_VERSION,
+        .Type = cmsPluginMemHandlerSig,
+        .Next = nullptr
+    },
+    .MallocPtr = trackedMalloc<pooled>,
+    .FreePtr = trackedFree,
+    .ReallocPtr = trackedRealloc<pooled>,
+    .MallocZeroPtr = nullptr,
+    .CallocPtr = nullptr,
+    .DupPtr = nullptr
+};
+
+
+void* fn_nonnull lcmsPoolMemoryHandler() {
+    return &memoryHandler<true>;
+}
+
+
+void* fn_nonnull lcmsSystemMemoryHandler() {
+    return &memoryHandler<false>;
+}
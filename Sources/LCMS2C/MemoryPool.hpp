@@ -0,0 +1,25 @@
+//
+//  MemoryPool.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <lcms2.h>
+
+
+/// lcms memory handler plugin that serves allocations from size-class pools.
+///
+/// Small blocks come from per-thread free lists that are refilled from process-wide ones, which are carved out of 64 KiB slabs. Freeing a parsed profile or a transform pushes its blocks back onto a list instead of going through `free` hundreds of times. Blocks larger than 4 KiB go straight to the system allocator.
+///
+/// Blocks are counted in the calling thread's ``LCMSMemoryTracker``, if there is one, and uncounted in the tracker they were counted in when they're released.
+///
+/// Memory handlers can only be set when a context is created, so pass the plugin to `cmsCreateContext`. Duplicates made by `cmsDupContext` would be freed with the system allocator, so create every context this way. Pooled memory is reused but never returned to the system.
+void* fn_nonnull lcmsPoolMemoryHandler();
+
+
+/// lcms memory handler plugin that allocates every block with `malloc`, counted like the blocks of ``lcmsPoolMemoryHandler()``.
+void* fn_nonnull lcmsSystemMemoryHandler();
@@ -0,0 +1,347 @@
+//
+//  MemoryTracker.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "MemoryTracker.hpp"
+#include <utility>
+#include <cstdlib>
+
+
+/// Bytes a thread batches per tracker and category before it adds them to the tracker. Bounds how much a report can miss.
+static constexpr long maxPendingBytes = 64 * 1024;
+
+/// References a thread takes at once for the blocks it allocates.
+static constexpr long numReservedReferences = 64;
+
+/// Trackers a thread batches counts for at the same time, usually a conversion and its context.
+static constexpr long numPendingTrackers = 4;
+
+
+static thread_local LCMSMemoryTracker* currentTracker = nullptr;
+static thread_local LCMSMemoryCategory currentCategory = LCMSMemoryCategory::lcms;
+static thread_local LCMSMemoryReport lastConversionReport = { };
+
+/// Memory scopes the calling thread is inside of. Counts are only batched in scopes, which add them when they end.
+static thread_local long scopeDepth = 0;
+
+
+/// Counts of a tracker the calling thread hasn't added to it yet. Allocations and deallocations of the same thread mostly cancel out, so the tracker's shared counters are rarely touched.
+struct LCMSPendingMemoryCounts {
+    LCMSMemoryTracker* fn_nullable tracker;
+    
+    /// References the thread holds: one that keeps the tracker alive while it's batched, plus the ones for blocks it's going to allocate and for blocks it deallocated. Blocks are referenced before they exist, so any thread can release them right away.
+    long numReferences;
+    
+    /// Bytes per category, followed by the total.
+    long bytes[LCMSMemoryTracker::numCategories + 1];
+    
+    void add(long index, long count) {
+        bytes[index] += count;
+        bytes[LCMSMemoryTracker::numCategories] += count;
+        if (std::abs(bytes[index]) > maxPendingBytes || std::abs(bytes[LCMSMemoryTracker::numCategories]) > maxPendingBytes) {
+            flushBytes();
+        }
+    }
+    
+    void flushBytes() {
+        for (long i = 0; i <= LCMSMemoryTracker::numCategories; i++) {
+            if (bytes[i] != 0) {
+                tracker->_add(i, bytes[i]);
+                bytes[i] = 0;
+            }
+        }
+    }
+    
+    void flush() {
+        if (tracker == nullptr) {
+            return;
+        }
+        
+        flushBytes();
+        std::exchange(tracker, nullptr)->_release(std::exchange(numReferences, 0));
+    }
+    
+    /// Returns the counts of the `tracker`, or `nullptr` if the calling thread isn't inside of a memory scope. Counts are only made room for if `create` is set.
+    static LCMSPendingMemoryCounts* fn_nullable find(LCMSMemoryTracker* fn_nonnull tracker, bool create);
+    
+    /// Adds the counts of every tracker.
+    static void flushAll();
+};
+
+
+/// Trivially destructible, it's empty whenever the thread is outside of a memory scope.
+static thread_local LCMSPendingMemoryCounts pendingCounts[numPendingTrackers] = { };
+static thread_local long nextPendingCounts = 0;
+
+
+LCMSPendingMemoryCounts* fn_nullable LCMSPendingMemoryCounts::find(LCMSMemoryTracker* fn_nonnull tracker, bool create) {
+    if (scopeDepth == 0) {
+        return nullptr;
+    }
+    
+    for (auto& counts: pendingCounts) {
+        if (counts.tracker == tracker) {
+            return &counts;
+        }
+    }
+    
+    if (create == false) {
+        return nullptr;
+    }
+    
+    // Evicts the trackers in turn
+    auto& counts = pendingCounts[nextPendingCounts];
+    nextPendingCounts = (nextPendingCounts + 1) % numPendingTrackers;
+    counts.flush();
+    counts.tracker = tracker;
+    counts.numReferences = 1;
+    tracker->retain();
+    return &counts;
+}
+
+
+void LCMSPendingMemoryCounts::flushAll() {
+    for (auto& counts: pendingCounts) {
+        counts.flush();
+    }
+}
+
+
+LCMSMemoryTracker::LCMSMemoryTracker(LCMSMemoryTracker* fn_nullable parent):
+_referenceCounter(1),
+_parent(parent),
+_current { },
+_peak { } {
+    if (_parent) {
+        _parent->retain();
+    }
+}
+
+
+LCMSMemoryTracker::~LCMSMemoryTracker() {
+    if (_parent) {
+        _parent->release();
+    }
+}
+
+
+LCMSMemoryTracker* fn_nonnull LCMSMemoryTracker::create(LCMSMemoryTracker* fn_nullable parent) {
+    return new LCMSMemoryTracker(parent);
+}
+
+
+void LCMSMemoryTracker::retain() {
+    _referenceCounter.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void LCMSMemoryTracker::release() {
+    _release(1);
+}
+
+
+void LCMSMemoryTracker::_release(long count) {
+    if (_referenceCounter.fetch_sub(count, std::memory_order_acq_rel) == count) {
+        delete this;
+    }
+}
+
+
+void LCMSMemoryTracker::_add(long index, long bytes) {
+    for (auto tracker = this; tracker; tracker = tracker->_parent) {
+        auto current = tracker->_current[index].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        auto& peak = tracker->_peak[index];
+        auto previousPeak = peak.load(std::memory_order_relaxed);
+        while (current > previousPeak && peak.compare_exchange_weak(previousPeak, current, std::memory_order_relaxed) == false) {
+            //
+        }
+    }
+}
+
+
+void LCMSMemoryTracker::allocate(LCMSMemoryCategory category, long bytes) {
+    auto pending = LCMSPendingMemoryCounts::find(this, true);
+    if (pending == nullptr) {
+        retain();
+        _add(static_cast<long>(category), bytes);
+        _add(numCategories, bytes);
+        return;
+    }
+    
+    if (pending->numReferences == 1) {
+        _referenceCounter.fetch_add(numReservedReferences, std::memory_order_relaxed);
+        pending->numReferences += numReservedReferences;
+    }
+    pending->numReferences--;
+    pending->add(static_cast<long>(category), bytes);
+}
+
+
+void LCMSMemoryTracker::deallocate(LCMSMemoryCategory category, long bytes) {
+    auto pending = LCMSPendingMemoryCounts::find(this, false);
+    if (pending == nullptr) {
+        _add(static_cast<long>(category), -bytes);
+        _add(numCategories, -bytes);
+        release();
+        return;
+    }
+    
+    // The block's reference is released with the thread's other references
+    pending->numReferences++;
+    pending->add(static_cast<long>(category), -bytes);
+}
+
+
+void LCMSMemoryTracker::resize(LCMSMemoryCategory category, long oldBytes, long newBytes) {
+    auto pending = LCMSPendingMemoryCounts::find(this, false);
+    if (pending == nullptr) {
+        _add(static_cast<long>(category), newBytes - oldBytes);
+        _add(numCategories, newBytes - oldBytes);
+        return;
+    }
+    
+    pending->add(static_cast<long>(category), newBytes - oldBytes);
+}
+
+
+LCMSMemoryReport LCMSMemoryTracker::getReport() const {
+    auto usage = [](const std::atomic<long>* fn_nonnull values) {
+        return LCMSMemoryUsage {
+            .pixels = values[static_cast<long>(LCMSMemoryCategory::pixels)].load(std::memory_order_relaxed),
+            .scratch = values[static_cast<long>(LCMSMemoryCategory::scratch)].load(std::memory_order_relaxed),
+            .lcms = values[static_cast<long>(LCMSMemoryCategory::lcms)].load(std::memory_order_relaxed),
+            .profiles = values[static_cast<long>(LCMSMemoryCategory::profiles)].load(std::memory_order_relaxed),
+            .total = values[numCategories].load(std::memory_order_relaxed)
+        };
+    };
+    
+    return {
+        .current = usage(_current),
+        .peak = usage(_peak)
+    };
+}
+
+
+void LCMSMemoryTracker::resetPeak() {
+    for (long i = 0; i <= numCategories; i++) {
+        _peak[i].store(_current[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+
+LCMSMemoryTracker* fn_nullable LCMSMemoryTracker::current() {
+    return currentTracker;
+}
+
+
+LCMSMemoryCategory LCMSMemoryTracker::currentCategory() {
+    return ::currentCategory;
+}
+
+
+LCMSMemoryTracker* fn_nonnull LCMSMemoryTracker::select(LCMSMemoryTracker* fn_nonnull tracker) {
+    if (currentTracker && currentTracker->_parent == tracker) {
+        return currentTracker;
+    }
+    return tracker;
+}
+
+
+//
+
+LCMSMemoryScope::LCMSMemoryScope(LCMSMemoryTracker* fn_nonnull tracker, LCMSMemoryCategory category):
+_previousTracker(currentTracker),
+_previousCategory(currentCategory) {
+    currentTracker = LCMSMemoryTracker::select(tracker);
+    currentCategory = category;
+    scopeDepth++;
+}
+
+
+LCMSMemoryScope::~LCMSMemoryScope() {
+    LCMSPendingMemoryCounts::flushAll();
+    scopeDepth--;
+    currentTracker = _previousTracker;
+    currentCategory = _previousCategory;
+}
+
+
+//
+
+LCMSConversionMemoryScope::LCMSConversionMemoryScope(LCMSMemoryTracker* fn_nonnull tracker):
+_tracker(nullptr),
+_previousTracker(currentTracker),
+_previousCategory(currentCategory) {
+    scopeDepth++;
+    
+    // Already inside of a conversion of this context
+    if (currentTracker && currentTracker->getParent() == tracker) {
+        return;
+    }
+    
+    _tracker = LCMSMemoryTracker::create(tracker);
+    currentTracker = _tracker;
+    currentCategory = LCMSMemoryCategory::lcms;
+}
+
+
+LCMSConversionMemoryScope::~LCMSConversionMemoryScope() {
+    // The report includes what the thread batched
+    LCMSPendingMemoryCounts::flushAll();
+    scopeDepth--;
+    currentTracker = _previousTracker;
+    currentCategory = _previousCategory;
+    
+    if (_tracker) {
+        lastConversionReport = _tracker->getReport();
+        _tracker->release();
+    }
+}
+
+
+LCMSMemoryReport LCMSConversionMemoryScope::getLastReport() {
+    return lastConversionReport;
+}
+
+
+//
+
+LCMSTrackedMemory::LCMSTrackedMemory(LCMSMemoryTracker* fn_nullable tracker, LCMSMemoryCategory category, long size):
+_tracker(tracker),
+_category(category),
+_size(size) {
+    if (_tracker) {
+        _tracker->allocate(_category, _size);
+    }
+}
+
+
+LCMSTrackedMemory::~LCMSTrackedMemory() {
+    if (_tracker) {
+        _tracker->deallocate(_category, _size);
+    }
+}
+
+
+LCMSTrackedMemory::LCMSTrackedMemory(LCMSTrackedMemory&& other):
+_tracker(std::exchange(other._tracker, nullptr)),
+_category(other._category),
+_size(other._size) {
+    //
+}
+
+
+LCMSTrackedMemory& LCMSTrackedMemory::operator=(LCMSTrackedMemory&& other) {
+    if (this != &other) {
+        if (_tracker) {
+            _tracker->deallocate(_category, _size);
+        }
+        _tracker = std::exchange(other._tracker, nullptr);
+        _category = other._category;
+        _size = other._size;
+    }
+    return *this;
+}
@@ -0,0 +1,125 @@
+//
+//  MemoryTracker.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <LCMS2C/MemoryReport.hpp>
+
+
+/// Counts the current and peak bytes of a context or of a single conversion.
+///
+/// Every allocation keeps the tracker it was counted in alive, so memory can be released after its context or conversion is gone. Allocations counted in a conversion are counted in its context as well.
+///
+/// Inside of a memory scope, a thread batches its counts and takes references for its allocations in bulk, so allocations don't contend on the shared counters. The batch is added when the scope ends or grows too large.
+class LCMSMemoryTracker final {
+private:
+    friend struct LCMSPendingMemoryCounts;
+    
+    static constexpr long numCategories = 4;
+    
+    std::atomic<long> _referenceCounter;
+    LCMSMemoryTracker* fn_nullable _parent;
+    
+    /// Bytes per category, followed by the total.
+    std::atomic<long> _current[numCategories + 1];
+    std::atomic<long> _peak[numCategories + 1];
+    
+    explicit LCMSMemoryTracker(LCMSMemoryTracker* fn_nullable parent);
+    ~LCMSMemoryTracker();
+    
+    void _add(long index, long bytes);
+    void _release(long count);
+    
+public:
+    /// Creates a tracker that forwards its counts to the `parent`.
+    static LCMSMemoryTracker* fn_nonnull create(LCMSMemoryTracker* fn_nullable parent = nullptr);
+    
+    void retain();
+    void release();
+    
+    LCMSMemoryTracker* fn_nullable getParent() const { return _parent; }
+    
+    /// Counts `bytes` that were allocated. The allocation retains the tracker until it's deallocated.
+    void allocate(LCMSMemoryCategory category, long bytes);
+    void deallocate(LCMSMemoryCategory category, long bytes);
+    
+    /// Counts an allocation that changed its size in place.
+    void resize(LCMSMemoryCategory category, long oldBytes, long newBytes);
+    
+    /// Counts batched by threads that are still inside of a memory scope are missing, at most 64 KB per thread and category.
+    LCMSMemoryReport getReport() const;
+    
+    /// Lowers the peaks to the current usage.
+    void resetPeak();
+    
+    /// Tracker and category the calling thread counts lcms allocations in, set by ``LCMSMemoryScope``. `nullptr` if allocations aren't counted.
+    static LCMSMemoryTracker* fn_nullable current();
+    static LCMSMemoryCategory currentCategory();
+    
+    /// Returns the calling thread's conversion tracker if it belongs to the `tracker` of a context, otherwise the `tracker` itself.
+    static LCMSMemoryTracker* fn_nonnull select(LCMSMemoryTracker* fn_nonnull tracker);
+};
+
+
+/// Counts lcms allocations made on the calling thread in a category while the scope is alive.
+class LCMSMemoryScope final {
+private:
+    LCMSMemoryTracker* fn_nullable _previousTracker;
+    LCMSMemoryCategory _previousCategory;
+    
+public:
+    /// Allocations go to the running conversion if it belongs to the context's `tracker`, otherwise to the `tracker` itself.
+    LCMSMemoryScope(LCMSMemoryTracker* fn_nonnull tracker, LCMSMemoryCategory category);
+    ~LCMSMemoryScope();
+    
+    LCMSMemoryScope(const LCMSMemoryScope&) = delete;
+    LCMSMemoryScope& operator=(const LCMSMemoryScope&) = delete;
+};
+
+
+/// Counts the memory of a single conversion call made on the calling thread, on top of the context's `tracker`.
+///
+/// When the scope ends, its report becomes the thread's last conversion report. Conversions nested in another conversion of the same context are counted in the outer one.
+class LCMSConversionMemoryScope final {
+private:
+    LCMSMemoryTracker* fn_nullable _tracker;
+    LCMSMemoryTracker* fn_nullable _previousTracker;
+    LCMSMemoryCategory _previousCategory;
+    
+public:
+    explicit LCMSConversionMemoryScope(LCMSMemoryTracker* fn_nonnull tracker);
+    ~LCMSConversionMemoryScope();
+    
+    LCMSConversionMemoryScope(const LCMSConversionMemoryScope&) = delete;
+    LCMSConversionMemoryScope& operator=(const LCMSConversionMemoryScope&) = delete;
+    
+    /// Report of the last conversion that finished on the calling thread.
+    static LCMSMemoryReport getLastReport();
+};
+
+
+/// Counts a block of wrapper memory for as long as it's alive.
+class LCMSTrackedMemory final {
+private:
+    LCMSMemoryTracker* fn_nullable _tracker;
+    LCMSMemoryCategory _category;
+    long _size;
+    
+public:
+    LCMSTrackedMemory(): _tracker(nullptr), _category(LCMSMemoryCategory::scratch), _size(0) { }
+    
+    /// Counts `size` bytes in the `tracker`. Nothing is counted if the `tracker` is `nullptr`.
+    LCMSTrackedMemory(LCMSMemoryTracker* fn_nullable tracker, LCMSMemoryCategory category, long size);
+    ~LCMSTrackedMemory();
+    
+    LCMSTrackedMemory(LCMSTrackedMemory&& other);
+    LCMSTrackedMemory& operator=(LCMSTrackedMemory&& other);
+    
+    LCMSTrackedMemory(const LCMSTrackedMemory&) = delete;
+    LCMSTrackedMemory& operator=(const LCMSTrackedMemory&) = delete;
+};
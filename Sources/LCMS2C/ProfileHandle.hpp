@@ -0,0 +1,18 @@
+//
+//  ProfileHandle.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <LCMS2C/ColorProfile.hpp>
+#include <lcms2.h>
+
+
+/// Parsed handle of a colour profile, or of the built-in sRGB profile if no colour profile is specified. The built-in profile lives as long as the process, so the handle never has to be closed.
+static inline cmsHPROFILE fn_nullable lcmsProfileHandle(LCMSColorProfile* fn_nullable profile) {
+    return (profile ? profile : LCMSColorProfile::createSRGB())->getHandle();
+}
@@ -0,0 +1,88 @@
+//
+//  ProfileHeader.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "ProfileHeader.hpp"
+#include <cstring>
+#include <algorithm>
+
+
+/// Signature, offset and size.
+static constexpr long tagEntrySize = 12;
+
+
+static uint32_t readUInt32(const uint8_t* fn_nonnull bytes) {
+    return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+}
+
+
+bool LCMSProfileHeader::read(const void* fn_nonnull data, long size, LCMSProfileHeader& header) {
+    constexpr uint32_t magicNumber = 0x61637370; // 'acsp'
+    
+    if (size < minSize) {
+        return false;
+    }
+    
+    auto bytes = static_cast<const uint8_t*>(data);
+    if (readUInt32(bytes + 36) != magicNumber) {
+        return false;
+    }
+    
+    // Like lcms, a declared size beyond the data is taken as the size of the data
+    header.profileSize = std::min(readUInt32(bytes), static_cast<uint32_t>(std::min<long>(size, UINT32_MAX)));
+    
+    header.version = readUInt32(bytes + 8);
+    header.deviceClass = readUInt32(bytes + 12);
+    header.colorSpace = readUInt32(bytes + 16);
+    header.pcs = readUInt32(bytes + 20);
+    header.renderingIntent = readUInt32(bytes + 64);
+    std::memcpy(&header.profileID, bytes + 84, sizeof(header.profileID));
+    
+    // The tag table has to be there, tags with bad offsets are only skipped
+    header.numTags = readUInt32(bytes + 128);
+    header.tagTable = bytes + minSize;
+    if (header.numTags > maxNumTags || minSize + header.numTags * tagEntrySize > size) {
+        return false;
+    }
+    
+    return true;
+}
+
+
+double LCMSProfileHeader::getVersion() const {
+    // Binary-coded decimal: major byte, minor and bug fix nibbles
+    auto major = (version >> 24) & 0xFF;
+    auto minor = (version >> 20) & 0x0F;
+    auto bugFix = (version >> 16) & 0x0F;
+    return (major / 16 * 1000 + major % 16 * 100 + minor * 10 + bugFix) / 100.0;
+}
+
+
+bool LCMSProfileHeader::findTag(uint32_t signature, uint32_t* fn_nullable offset, uint32_t* fn_nullable size) const {
+    for (uint32_t i = 0; i < numTags; i++) {
+        auto entry = tagTable + i * tagEntrySize;
+        if (readUInt32(entry) != signature) {
+            continue;
+        }
+        
+        // lcms skips empty tags and tags outside of the profile. 64-bit sums don't overflow
+        auto tagOffset = static_cast<uint64_t>(readUInt32(entry + 4));
+        auto tagSize = static_cast<uint64_t>(readUInt32(entry + 8));
+        if (tagOffset == 0 || tagSize == 0 || tagOffset + tagSize > profileSize) {
+            continue;
+        }
+        
+        if (offset) {
+            *offset = readUInt32(entry + 4);
+        }
+        if (size) {
+            *size = readUInt32(entry + 8);
+        }
+        return true;
+    }
+    
+    return false;
+}
@@ -0,0 +1,49 @@
+//
+//  ProfileHeader.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <LCMS2C/ColorProfile.hpp>
+#include <cstdint>
+
+
+/// ICC profile header and tag table, read in place from the profile data.
+///
+/// Reading doesn't allocate or parse any tag, so it's cheap enough for routing decisions. It rejects exactly what lcms rejects when it opens a profile, so data that fails here would fail there too, and lcms doesn't spend time on it.
+///
+/// - Note: The header points into the data it was read from, it has to outlive the header.
+struct LCMSProfileHeader {
+    /// Size of the header plus the tag count.
+    static constexpr long minSize = 132;
+    
+    /// lcms doesn't open profiles with more tags.
+    static constexpr uint32_t maxNumTags = 100;
+    
+    /// Declared size, at most the size of the data.
+    uint32_t profileSize;
+    uint32_t version;
+    uint32_t deviceClass;
+    uint32_t colorSpace;
+    uint32_t pcs;
+    uint32_t renderingIntent;
+    
+    /// Zero if the profile doesn't store it.
+    LCMSProfileID profileID;
+    
+    uint32_t numTags;
+    const uint8_t* fn_nonnull tagTable;
+    
+    /// Reads the header of the ICC `data`. Returns `false` if lcms wouldn't open the data: it's too short, has no `acsp` signature, too many tags, or the tag table is cut off.
+    static bool read(const void* fn_nonnull data, long size, LCMSProfileHeader& header);
+    
+    /// Version as lcms reports it, for example `4.3`.
+    double getVersion() const;
+    
+    /// Looks up a tag in the tag table. Like lcms, empty tags and tags outside of the profile are skipped. `offset` and `size` are only set if it's found.
+    bool findTag(uint32_t signature, uint32_t* fn_nullable offset = nullptr, uint32_t* fn_nullable size = nullptr) const;
+};
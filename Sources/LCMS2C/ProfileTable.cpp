@@ -0,0 +1,72 @@
+//
+//  ProfileTable.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "ProfileTable.hpp"
+#include <cstring>
+
+
+LCMSColorProfile* fn_nullable LCMSProfileTable::_find(Shard& shard, const LCMSProfileID& profileID, const void* fn_nonnull data, long size) {
+    auto [first, last] = shard.profiles.equal_range(profileID);
+    for (auto it = first; it != last; it++) {
+        auto profile = it->second;
+        if (profile->_size != size || std::memcmp(profile->_data, data, size) != 0) {
+            continue;
+        }
+        
+        // Dying profiles are skipped, they remove themselves
+        auto count = profile->_referenceCounter.load();
+        while (count > 0) {
+            if (profile->_referenceCounter.compare_exchange_weak(count, count + 1)) {
+                return profile;
+            }
+        }
+    }
+    
+    return nullptr;
+}
+
+
+LCMSColorProfile* fn_nonnull LCMSProfileTable::intern(const LCMSProfileID& profileID, const void* fn_nonnull data, long size, const std::function<LCMSColorProfile*()>& create) {
+    auto& shard = _shard(profileID);
+    {
+        std::lock_guard lock(shard.mutex);
+        if (auto profile = _find(shard, profileID, data, size)) {
+            return profile;
+        }
+    }
+    
+    auto profile = create();
+    
+    std::unique_lock lock(shard.mutex);
+    if (auto existing = _find(shard, profileID, data, size)) {
+        lock.unlock();
+        
+        // Not interned, so it doesn't touch the table
+        LCMSColorProfileRelease(profile);
+        return existing;
+    }
+    
+    std::call_once(profile->_profileIDOnce, [&]() {
+        profile->_profileID = profileID;
+    });
+    profile->_interned = true;
+    shard.profiles.emplace(profileID, profile);
+    return profile;
+}
+
+
+void LCMSProfileTable::remove(LCMSColorProfile* fn_nonnull profile) {
+    auto& shard = _shard(profile->_profileID);
+    std::lock_guard lock(shard.mutex);
+    auto [first, last] = shard.profiles.equal_range(profile->_profileID);
+    for (auto it = first; it != last; it++) {
+        if (it->second == profile) {
+            shard.profiles.erase(it);
+            return;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+//
+//  ProfileTable.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <LCMS2C/ColorProfile.hpp>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+
+
+/// Weak table of the interned colour profiles of a context, keyed by profile ID.
+///
+/// The table doesn't retain its profiles, they remove themselves when they're destroyed. A profile whose last reference is being released is never handed out again.
+class LCMSProfileTable final {
+private:
+    struct Hash {
+        size_t operator()(const LCMSProfileID& profileID) const { return static_cast<size_t>(profileID.high ^ profileID.low); }
+    };
+    
+    /// Profiles are spread over shards by ID, so that lookups of different profiles don't contend.
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_multimap<LCMSProfileID, LCMSColorProfile*, Hash> profiles;
+    };
+    
+    static constexpr size_t numShards = 16;
+    Shard _shards[numShards];
+    
+    Shard& _shard(const LCMSProfileID& profileID) { return _shards[Hash()(profileID) % numShards]; }
+    
+    /// Returns a retained live profile with the same bytes, the shard has to be locked.
+    static LCMSColorProfile* fn_nullable _find(Shard& shard, const LCMSProfileID& profileID, const void* fn_nonnull data, long size);
+    
+public:
+    LCMSProfileTable() = default;
+    
+    LCMSProfileTable(const LCMSProfileTable&) = delete;
+    LCMSProfileTable& operator=(const LCMSProfileTable&) = delete;
+    
+    /// Returns a retained profile with the same bytes as `data`, or adds the one returned by `create`.
+    ///
+    /// `create` is called without holding a lock. If another thread adds the same profile in the meantime, the new one is released and the other one returned.
+    LCMSColorProfile* fn_nonnull intern(const LCMSProfileID& profileID, const void* fn_nonnull data, long size, const std::function<LCMSColorProfile*()>& create);
+    
+    /// Called by an interned profile that's being destroyed.
+    void remove(LCMSColorProfile* fn_nonnull profile);
+};
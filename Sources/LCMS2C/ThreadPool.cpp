@@ -0,0 +1,178 @@
+//
+//  ThreadPool.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+
+/// Pool and index of the worker running on the current thread.
+static thread_local const LCMSThreadPool* currentPool = nullptr;
+static thread_local long currentWorkerIndex = -1;
+
+
+LCMSThreadPool::LCMSThreadPool(long numWorkers):
+_pending(0),
+_nextQueue(0),
+_stopping(false) {
+    for (long i = 0; i < numWorkers; i++) {
+        _queues.push_back(std::make_unique<Queue>());
+    }
+    
+    for (long i = 0; i < numWorkers; i++) {
+        _workers.emplace_back([this, i]() { _work(i); });
+    }
+}
+
+
+LCMSThreadPool::~LCMSThreadPool() {
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+    
+    for (auto& worker: _workers) {
+        worker.join();
+    }
+}
+
+
+void LCMSThreadPool::_submit(Task task) {
+    // Keep work on the submitting worker, spread external work round-robin
+    long queueIndex = 0;
+    if (currentPool == this) {
+        queueIndex = currentWorkerIndex;
+    }
+    else {
+        std::lock_guard lock(_mutex);
+        queueIndex = _nextQueue;
+        _nextQueue = (_nextQueue + 1) % static_cast<long>(_queues.size());
+    }
+    
+    {
+        auto& queue = *_queues[queueIndex];
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    
+    {
+        std::lock_guard lock(_mutex);
+        _pending++;
+    }
+    _condition.notify_one();
+}
+
+
+bool LCMSThreadPool::_take(long workerIndex, Task& task) {
+    // Own work first, newest first
+    {
+        auto& queue = *_queues[workerIndex];
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty() == false) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+    
+    // Steal the oldest task of another worker
+    auto numQueues = static_cast<long>(_queues.size());
+    for (long offset = 1; offset < numQueues; offset++) {
+        auto& queue = *_queues[(workerIndex + offset) % numQueues];
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty() == false) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+
+void LCMSThreadPool::_work(long workerIndex) {
+    currentPool = this;
+    currentWorkerIndex = workerIndex;
+    
+    while (true) {
+        Task task;
+        if (_take(workerIndex, task)) {
+            {
+                std::lock_guard lock(_mutex);
+                _pending--;
+            }
+            task();
+            continue;
+        }
+        
+        std::unique_lock lock(_mutex);
+        _condition.wait(lock, [this]() { return _stopping || _pending > 0; });
+        if (_stopping && _pending == 0) {
+            return;
+        }
+    }
+}
+
+
+void LCMSThreadPool::parallelFor(long count, long numThreads, const std::function<void(long index)>& body) {
+    if (count < 1) {
+        return;
+    }
+    
+    numThreads = std::clamp(numThreads, 1l, std::min(count, getMaxConcurrency()));
+    if (numThreads == 1) {
+        for (long i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+    
+    // Shared between the caller and the helpers, which may start after the loop is already done
+    struct Loop {
+        std::atomic<long> next = 0;
+        long completed = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto loop = std::make_shared<Loop>();
+    
+    auto run = [loop, count, &body]() {
+        long finished = 0;
+        for (auto index = loop->next.fetch_add(1); index < count; index = loop->next.fetch_add(1)) {
+            body(index);
+            finished++;
+        }
+        
+        if (finished > 0) {
+            std::lock_guard lock(loop->mutex);
+            loop->completed += finished;
+            if (loop->completed == count) {
+                loop->done.notify_all();
+            }
+        }
+    };
+    
+    for (long i = 1; i < numThreads; i++) {
+        // Helpers only touch `body` while indices are left, and the caller waits for all of them
+        _submit(run);
+    }
+    
+    run();
+    
+    std::unique_lock lock(loop->mutex);
+    loop->done.wait(lock, [&]() { return loop->completed == count; });
+}
+
+
+LCMSThreadPool& LCMSThreadPool::shared() {
+    // Intentionally leaked, worker threads must not be joined during static destruction
+    static auto pool = new LCMSThreadPool(std::max(1l, static_cast<long>(std::thread::hardware_concurrency()) - 1));
+    return *pool;
+}
@@ -0,0 +1,63 @@
+//
+//  ThreadPool.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+
+/// Persistent work-stealing pool of worker threads for data-parallel loops.
+///
+/// Every worker owns a task deque. Tasks submitted from a worker go to its own deque and are taken back newest first, so nested loops stay on the same core. Idle workers steal the oldest tasks from the others.
+class LCMSThreadPool final {
+private:
+    using Task = std::function<void()>;
+    
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _workers;
+    
+    /// Guards sleeping and waking up of idle workers.
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    long _pending;
+    long _nextQueue;
+    bool _stopping;
+    
+    void _submit(Task task);
+    bool _take(long workerIndex, Task& task);
+    void _work(long workerIndex);
+    
+public:
+    explicit LCMSThreadPool(long numWorkers);
+    ~LCMSThreadPool();
+    
+    LCMSThreadPool(const LCMSThreadPool&) = delete;
+    LCMSThreadPool& operator=(const LCMSThreadPool&) = delete;
+    
+    /// Maximum number of threads that can run a loop at the same time, including the calling thread.
+    long getMaxConcurrency() const { return static_cast<long>(_workers.size()) + 1; }
+    
+    /// Calls `body` for every index in `[0, count)` using up to `numThreads` threads, and returns when all of them are done.
+    ///
+    /// The calling thread takes part in the work, so it's safe to call from inside a worker.
+    void parallelFor(long count, long numThreads, const std::function<void(long index)>& body);
+    
+    /// Process-wide pool with one thread per core.
+    static LCMSThreadPool& shared();
+};
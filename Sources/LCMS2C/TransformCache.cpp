@@ -0,0 +1,142 @@
+//
+//  TransformCache.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "TransformCache.hpp"
+#include <LCMS2C/ColorProfile.hpp>
+#include <cstring>
+#include <algorithm>
+
+
+static uint64_t fnv1a(const unsigned char* fn_nonnull bytes, size_t size, uint64_t seed) {
+    auto hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+
+/// Fingerprint of a built-in profile that has no ICC data, spelled out in its bytes.
+static LCMSProfileID builtInProfileID(const char* fn_nonnull name) {
+    LCMSProfileID profileID = { };
+    std::memcpy(&profileID, name, std::min(strlen(name), sizeof(profileID)));
+    return profileID;
+}
+
+
+LCMSProfileID LCMSTransformKey::identify(LCMSColorProfile* fn_nullable profile) {
+    if (profile == nullptr) {
+        return builtInProfileID("lcms:sRGB");
+    }
+    
+    return profile->getProfileID();
+}
+
+
+LCMSProfileID LCMSTransformKey::identify(const void* fn_nullable data, long size) {
+    if (data == nullptr || size <= 0) {
+        return builtInProfileID("lcms:sRGB");
+    }
+    
+    return LCMSProfileID::compute(data, size);
+}
+
+
+LCMSProfileID LCMSTransformKey::identifyLab() {
+    return builtInProfileID("lcms:Lab4");
+}
+
+
+size_t LCMSTransformKeyHash::operator()(const LCMSTransformKey& key) const {
+    auto hash = fnv1a(reinterpret_cast<const unsigned char*>(&key.sourceProfile), sizeof(key.sourceProfile), 0xCBF29CE484222325ull);
+    hash = fnv1a(reinterpret_cast<const unsigned char*>(&key.targetProfile), sizeof(key.targetProfile), hash);
+    
+    cmsUInt32Number parameters[] = { key.inputFormat, key.outputFormat, key.intent, key.flags };
+    hash = fnv1a(reinterpret_cast<const unsigned char*>(parameters), sizeof(parameters), hash);
+    
+    return static_cast<size_t>(hash);
+}
+
+
+LCMSCachedTransform::LCMSCachedTransform(cmsHTRANSFORM fn_nonnull transform, LCMSColorProfile* fn_nullable sourceProfile, LCMSColorProfile* fn_nullable targetProfile):
+_transform(transform),
+_sourceContext(sourceProfile ? sourceProfile->_context : nullptr),
+_targetContext(targetProfile ? targetProfile->_context : nullptr) {
+    //
+}
+
+
+LCMSCachedTransform::~LCMSCachedTransform() {
+    cmsDeleteTransform(_transform);
+}
+
+
+LCMSTransformCache::LCMSTransformCache(size_t capacity):
+_capacity(std::max<size_t>(capacity, 1)),
+_generation(0) {
+    //
+}
+
+
+void LCMSTransformCache::_evict() {
+    // Entries that are still being built stay reachable for their waiters through the shared future
+    while (_entries.size() > _capacity) {
+        auto& key = _usage.back();
+        _entries.erase(key);
+        _usage.pop_back();
+    }
+}
+
+
+LCMSTransformReference LCMSTransformCache::get(const LCMSTransformKey& key, const Builder& build) {
+    std::unique_lock lock(_mutex);
+    
+    // Hit, or somebody else is already building this transform
+    auto existing = _entries.find(key);
+    if (existing != _entries.end()) {
+        _usage.splice(_usage.begin(), _usage, existing->second.usage);
+        auto transform = existing->second.transform;
+        lock.unlock();
+        return transform.get();
+    }
+    
+    // Miss - register the pending entry so that concurrent callers wait for us
+    std::promise<LCMSTransformReference> promise;
+    auto generation = ++_generation;
+    _usage.push_front(key);
+    _entries.emplace(key, Entry {
+        .transform = promise.get_future().share(),
+        .usage = _usage.begin(),
+        .generation = generation
+    });
+    _evict();
+    lock.unlock();
+    
+    // Build outside of the lock
+    auto transform = build();
+    promise.set_value(transform);
+    
+    // Don't keep failures around, the next caller may succeed
+    if (transform == nullptr) {
+        lock.lock();
+        auto entry = _entries.find(key);
+        if (entry != _entries.end() && entry->second.generation == generation) {
+            _usage.erase(entry->second.usage);
+            _entries.erase(entry);
+        }
+    }
+    
+    return transform;
+}
+
+
+void LCMSTransformCache::clear() {
+    std::lock_guard lock(_mutex);
+    _entries.clear();
+    _usage.clear();
+}
@@ -0,0 +1,111 @@
+//
+//  TransformCache.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <LCMS2C/ColorProfile.hpp>
+#include <lcms2.h>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <functional>
+#include <unordered_map>
+
+
+/// Everything that makes two `cmsHTRANSFORM`s interchangeable.
+struct LCMSTransformKey {
+    LCMSProfileID sourceProfile;
+    LCMSProfileID targetProfile;
+    cmsUInt32Number inputFormat;
+    cmsUInt32Number outputFormat;
+    cmsUInt32Number intent;
+    cmsUInt32Number flags;
+    
+    bool operator==(const LCMSTransformKey& other) const = default;
+    
+    /// Fingerprint of a colour profile. `nullptr` stands for the built-in sRGB profile.
+    static LCMSProfileID identify(LCMSColorProfile* fn_nullable profile);
+    
+    /// Fingerprint of raw ICC profile data. `nullptr` stands for the built-in sRGB profile.
+    static LCMSProfileID identify(const void* fn_nullable data, long size);
+    
+    /// Fingerprint of the built-in D50 Lab v4 profile.
+    static LCMSProfileID identifyLab();
+};
+
+
+struct LCMSTransformKeyHash {
+    size_t operator()(const LCMSTransformKey& key) const;
+};
+
+
+/// Owns a `cmsHTRANSFORM` and deletes it when the last user lets it go.
+///
+/// Pipeline stages may keep memory allocated in the lcms contexts of the profiles the transform was built from, so those contexts are kept for the transform's lifetime. The profiles themselves aren't retained: they retain the `LCMSContext` whose cache holds the transform.
+class LCMSCachedTransform final {
+private:
+    cmsHTRANSFORM fn_nonnull _transform;
+    std::shared_ptr<_cmsContext_struct> _sourceContext;
+    std::shared_ptr<_cmsContext_struct> _targetContext;
+    
+public:
+    LCMSCachedTransform(cmsHTRANSFORM fn_nonnull transform, LCMSColorProfile* fn_nullable sourceProfile, LCMSColorProfile* fn_nullable targetProfile);
+    ~LCMSCachedTransform();
+    
+    LCMSCachedTransform(const LCMSCachedTransform&) = delete;
+    LCMSCachedTransform& operator=(const LCMSCachedTransform&) = delete;
+    
+    cmsHTRANSFORM fn_nonnull get() const { return _transform; }
+};
+
+
+using LCMSTransformReference = std::shared_ptr<LCMSCachedTransform>;
+
+
+/// Thread-safe bounded LRU cache of colour transforms. Every `LCMSContext` has its own.
+///
+/// Concurrent misses for the same key are coalesced: the first caller builds the transform, the others wait for its result.
+///
+/// - Note: Cached transforms are shared between threads, so they have to be created with `cmsFLAGS_NOCACHE`.
+class LCMSTransformCache final {
+private:
+    using Builder = std::function<LCMSTransformReference()>;
+    
+    struct Entry {
+        std::shared_future<LCMSTransformReference> transform;
+        std::list<LCMSTransformKey>::iterator usage;
+        size_t generation;
+    };
+    
+    std::mutex _mutex;
+    size_t _capacity;
+    size_t _generation;
+    
+    /// Most recently used key first.
+    std::list<LCMSTransformKey> _usage;
+    std::unordered_map<LCMSTransformKey, Entry, LCMSTransformKeyHash> _entries;
+    
+    void _evict();
+    
+public:
+    static constexpr size_t defaultCapacity = 64;
+    
+    explicit LCMSTransformCache(size_t capacity);
+    
+    LCMSTransformCache(const LCMSTransformCache&) = delete;
+    LCMSTransformCache& operator=(const LCMSTransformCache&) = delete;
+    
+    /// Returns a cached transform for the `key` or builds it with `build`.
+    ///
+    /// Returns `nullptr` if the transform could not be built. Failures are not cached.
+    LCMSTransformReference get(const LCMSTransformKey& key, const Builder& build);
+    
+    /// Drops all cached transforms. Transforms still in use stay alive until released.
+    void clear();
+};
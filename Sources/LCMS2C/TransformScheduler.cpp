@@ -0,0 +1,133 @@
+//
+//  TransformScheduler.cpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#include "TransformScheduler.hpp"
+#include "ThreadPool.hpp"
+#include <LCMS2C/LCMSContext.hpp>
+#include <lcms2_plugin.h>
+#include <algorithm>
+
+
+/// Smaller slices cost more in scheduling than they gain from running in parallel.
+static constexpr long minPixelsPerSlice = 64 * 1024;
+
+
+static thread_local long scopeTransformWorkers = 0;
+
+
+long lcmsCurrentTransformWorkers(cmsContext fn_nonnull context) {
+    // Transform contexts belong to an LCMSContext, profile contexts have no owner
+    auto owner = static_cast<LCMSContext*>(cmsGetContextUserData(context));
+    long numWorkers = scopeTransformWorkers ? scopeTransformWorkers : (owner ? owner->getMaxWorkers() : 0);
+    if (numWorkers <= 0) {
+        numWorkers = LCMSThreadPool::shared().getMaxConcurrency();
+    }
+    return numWorkers;
+}
+
+
+LCMSTransformWorkersScope::LCMSTransformWorkersScope(long numWorkers):
+_previous(scopeTransformWorkers) {
+    if (numWorkers > 0) {
+        scopeTransformWorkers = numWorkers;
+    }
+}
+
+
+LCMSTransformWorkersScope::~LCMSTransformWorkersScope() {
+    scopeTransformWorkers = _previous;
+}
+
+
+/// Size of a pixel in bytes, or `0` if pixels of the `format` can't be addressed one by one.
+static long pixelSize(cmsUInt32Number format) {
+    if (T_PLANAR(format)) {
+        return 0;
+    }
+    
+    // Zero bytes per channel stands for double
+    auto channelSize = T_BYTES(format) ? T_BYTES(format) : sizeof(cmsFloat64Number);
+    return static_cast<long>((T_CHANNELS(format) + T_EXTRA(format)) * channelSize);
+}
+
+
+/// Splits a transform call into slices of rows, or of pixels if there's a single row, and runs them on the shared pool.
+static void scheduleTransform(struct _cmstransform_struct* CMMcargo,
+                              const void* InputBuffer,
+                              void* OutputBuffer,
+                              cmsUInt32Number PixelsPerLine,
+                              cmsUInt32Number LineCount,
+                              const cmsStride* Stride) {
+    auto worker = _cmsGetTransformWorker(CMMcargo);
+    auto& pool = LCMSThreadPool::shared();
+    
+    auto numWorkers = lcmsCurrentTransformWorkers(cmsGetTransformContextID(static_cast<cmsHTRANSFORM>(CMMcargo)));
+    auto pluginWorkers = _cmsGetTransformMaxWorkers(CMMcargo);
+    if (pluginWorkers > 0) {
+        numWorkers = std::min(numWorkers, static_cast<long>(pluginWorkers));
+    }
+    
+    long width = PixelsPerLine;
+    long height = LineCount;
+    auto numSlices = std::min(numWorkers, std::max(1l, width * height / minPixelsPerSlice));
+    
+    // Split rows
+    if (numSlices > 1 && height > 1) {
+        numSlices = std::min(numSlices, height);
+        auto rowsPerSlice = (height + numSlices - 1) / numSlices;
+        numSlices = (height + rowsPerSlice - 1) / rowsPerSlice;
+        pool.parallelFor(numSlices, numWorkers, [&](long slice) {
+            auto firstRow = slice * rowsPerSlice;
+            auto numRows = std::min(rowsPerSlice, height - firstRow);
+            worker(CMMcargo,
+                   static_cast<const cmsUInt8Number*>(InputBuffer) + firstRow * Stride->BytesPerLineIn,
+                   static_cast<cmsUInt8Number*>(OutputBuffer) + firstRow * Stride->BytesPerLineOut,
+                   PixelsPerLine, static_cast<cmsUInt32Number>(numRows),
+                   Stride);
+        });
+        return;
+    }
+    
+    // Split a single row into runs of pixels
+    auto transform = static_cast<cmsHTRANSFORM>(CMMcargo);
+    auto inputPixelSize = pixelSize(cmsGetTransformInputFormat(transform));
+    auto outputPixelSize = pixelSize(cmsGetTransformOutputFormat(transform));
+    if (numSlices > 1 && inputPixelSize > 0 && outputPixelSize > 0) {
+        auto pixelsPerSlice = (width + numSlices - 1) / numSlices;
+        numSlices = (width + pixelsPerSlice - 1) / pixelsPerSlice;
+        pool.parallelFor(numSlices, numWorkers, [&](long slice) {
+            auto firstPixel = slice * pixelsPerSlice;
+            auto numPixels = std::min(pixelsPerSlice, width - firstPixel);
+            worker(CMMcargo,
+                   static_cast<const cmsUInt8Number*>(InputBuffer) + firstPixel * inputPixelSize,
+                   static_cast<cmsUInt8Number*>(OutputBuffer) + firstPixel * outputPixelSize,
+                   static_cast<cmsUInt32Number>(numPixels), 1,
+                   Stride);
+        });
+        return;
+    }
+    
+    worker(CMMcargo, InputBuffer, OutputBuffer, PixelsPerLine, LineCount, Stride);
+}
+
+
+bool lcmsInstallTransformScheduler(cmsContext fn_nonnull context) {
+    static cmsPluginParalellization plugin = {
+        .base = {
+            .Magic = cmsPluginMagicNumber,
+            .ExpectedVersion = LCMS_VERSION,
+            .Type = cmsPluginParalellizationSig,
+            .Next = nullptr
+        },
+        .MaxWorkers = CMS_GUESS_MAX_WORKERS,
+        .WorkerFlags = 0,
+        .SchedulerFn = scheduleTransform
+    };
+    
+    return cmsPluginTHR(context, &plugin);
+}
+
@@ -0,0 +1,37 @@
+//
+//  TransformScheduler.hpp
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+#pragma once
+
+#include <LCMS2C/Common.hpp>
+#include <lcms2.h>
+
+
+/// Installs the work-stealing transform scheduler as lcms parallelization plugin into the `context`.
+///
+/// Every `cmsDoTransform` and `cmsDoTransformLineStride` call on a transform created in the context is split into slices that run on the shared thread pool.
+bool lcmsInstallTransformScheduler(cmsContext fn_nonnull context);
+
+
+/// Number of threads a transform call made on the current thread in the `context` may use, with the scope and the context's limit applied.
+long lcmsCurrentTransformWorkers(cmsContext fn_nonnull context);
+
+
+/// Limits the number of threads transform calls made on the current thread may use while the scope is alive.
+///
+/// `0` keeps the context's limit.
+class LCMSTransformWorkersScope final {
+private:
+    long _previous;
+    
+public:
+    explicit LCMSTransformWorkersScope(long numWorkers);
+    ~LCMSTransformWorkersScope();
+    
+    LCMSTransformWorkersScope(const LCMSTransformWorkersScope&) = delete;
+    LCMSTransformWorkersScope& operator=(const LCMSTransformWorkersScope&) = delete;
+};
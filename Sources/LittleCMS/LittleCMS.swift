@@ -11,6 +11,15 @@ public enum LittleCMSError: Error {
 }
 
 
+/// Equality comes from the C++ `operator==`.
+extension LCMSProfileID: @retroactive Hashable {
+    public func hash(into hasher: inout Hasher) {
+        hasher.combine(high)
+        hasher.combine(low)
+    }
+}
+
+
 #if canImport(CoreGraphics)
 
 import CoreGraphics
@@ -0,0 +1,60 @@
+//
+//  ConversionPlannerTests.swift
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+import Testing
+import Foundation
+import LCMS2C
+
+
+/// Plan of an sRGB to Rec. 2020 transform of RGB pixels for `numPixels` pixels.
+private func plan(componentSize: Int, numPixels: Int, clipNegatives: Bool = true) throws -> LCMSConversionPlan {
+    var options = LCMSConversionOptions()
+    options.clipNegatives = clipNegatives
+    
+    let source = LCMSColorProfile.createSRGB(nil)
+    let target = LCMSColorProfile.createRec2020(nil)
+    let transform = try #require(LCMSTransform.create(source, target, 3, componentSize, options, numPixels, nil))
+    return transform.plan
+}
+
+
+private let lookupTablePlans: [LCMSConversionPlan] = [.lowResolution, .normal, .highResolution]
+
+
+@Suite("Conversion planner")
+struct ConversionPlannerTests {
+    @Test("Small float images are evaluated exactly, building the matrix-shaper kernel doesn't pay off", arguments: [2, 4])
+    func smallFloatImage(componentSize: Int) throws {
+        #expect(try plan(componentSize: componentSize, numPixels: 64 * 64) == .exact)
+    }
+    
+    @Test("Large float images take the matrix-shaper kernel", arguments: [2, 4])
+    func largeFloatImage(componentSize: Int) throws {
+        #expect(try plan(componentSize: componentSize, numPixels: 1024 * 1024) == .normal)
+        #expect(try plan(componentSize: componentSize, numPixels: 0) == .normal)
+    }
+    
+    @Test("Small 8-bit images are evaluated exactly, building a lookup table doesn't pay off")
+    func small8BitImage() throws {
+        #expect(try plan(componentSize: 1, numPixels: 64 * 64) == .exact)
+        #expect(try plan(componentSize: 1, numPixels: 256 * 256) == .exact)
+    }
+    
+    @Test("Large 8-bit images are precalculated into a lookup table")
+    func large8BitImage() throws {
+        let largeImagePlan = try plan(componentSize: 1, numPixels: 4096 * 4096)
+        let reusedPlan = try plan(componentSize: 1, numPixels: 0)
+        #expect(lookupTablePlans.contains(largeImagePlan))
+        #expect(lookupTablePlans.contains(reusedPlan))
+    }
+    
+    @Test("8-bit images without clipping take the fixed point path once it pays off")
+    func unclipped8BitImage() throws {
+        #expect(try plan(componentSize: 1, numPixels: 64 * 64, clipNegatives: false) == .exact)
+        #expect(try plan(componentSize: 1, numPixels: 256 * 256, clipNegatives: false) == .normal)
+    }
+}
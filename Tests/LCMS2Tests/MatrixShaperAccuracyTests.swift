@@ -0,0 +1,82 @@
+//
+//  MatrixShaperAccuracyTests.swift
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+import Testing
+import Foundation
+import LCMS2C
+
+
+private func builtInProfile(_ index: Int) -> LCMSColorProfile {
+    switch index {
+    case 0: LCMSColorProfile.createSRGB(nil)
+    case 1: LCMSColorProfile.createRec709(nil)
+    case 2: LCMSColorProfile.createRec2020(nil)
+    case 3: LCMSColorProfile.createDCIP3(nil)
+    default: LCMSColorProfile.createDCIP3D65(nil)
+    }
+}
+
+
+/// Every ordered pair of different built-in profiles.
+private let profilePairs: [(source: Int, target: Int)] = (0 ..< 5).flatMap { source in
+    (0 ..< 5).filter { $0 != source }.map { target in (source, target) }
+}
+
+
+/// RGB values in `0...1`, a quarter of them crowded near black, a quarter near white and a quarter exactly black, where out-of-gamut colours cancel out to almost zero.
+private func makeValues(count: Int) -> [Float] {
+    var random = SplitMix64(state: UInt64(count))
+    return (0 ..< count).map { _ in
+        let value = Float(random.next() % 1_000_001) / 1_000_000
+        switch random.next() % 4 {
+        case 0: return value
+        case 1: return value * value * value * value
+        case 2: return 0
+        default: return 1 - value * value * value * value
+        }
+    }
+}
+
+
+@Suite("Matrix-shaper kernel")
+struct MatrixShaperAccuracyTests {
+    @Test("Kernel output stays within the documented bound of the unoptimised lcms transform", arguments: 0 ..< profilePairs.count)
+    func matchesUnoptimisedTransform(pairIndex: Int) throws {
+        let source = builtInProfile(profilePairs[pairIndex].source)
+        let target = builtInProfile(profilePairs[pairIndex].target)
+        
+        let fast = try #require(LCMSTransform.create(source, target, 3, 4, LCMSConversionOptions.fast(), 0, nil))
+        let exact = try #require(LCMSTransform.create(source, target, 3, 4, LCMSConversionOptions.exact(), 0, nil))
+        #expect(fast.plan == .normal)
+        #expect(exact.plan == .exact)
+        
+        let numPixels = 1 << 16
+        let input = makeValues(count: numPixels * 3)
+        var fastOutput = [Float](repeating: 0, count: input.count)
+        var exactOutput = [Float](repeating: 0, count: input.count)
+        input.withUnsafeBytes { input in
+            fastOutput.withUnsafeMutableBytes { output in
+                #expect(fast.apply(input.baseAddress!, output.baseAddress!, numPixels, 1, 0, 0, 1))
+            }
+            exactOutput.withUnsafeMutableBytes { output in
+                #expect(exact.apply(input.baseAddress!, output.baseAddress!, numPixels, 1, 0, 0, 1))
+            }
+        }
+        
+        var maxError: Float = 0
+        var maxBrightError: Float = 0
+        for (fast, exact) in zip(fastOutput, exactOutput) {
+            let error = abs(fast - exact)
+            maxError = max(maxError, error)
+            if exact >= 1.0 / 64 {
+                maxBrightError = max(maxBrightError, error)
+            }
+        }
+        #expect(maxBrightError <= 0x1p-14, "\(maxBrightError) for outputs of at least 1/64")
+        #expect(maxError <= 0x1p-9, "\(maxError) overall")
+    }
+}
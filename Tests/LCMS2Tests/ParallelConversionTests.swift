@@ -0,0 +1,107 @@
+//
+//  ParallelConversionTests.swift
+//  LCMS2
+//
+//  Created by Evgenij Lutz on 17.10.26.
+//
+
+import Testing
+import Foundation
+import LCMS2C
+
+
+/// Deterministic pixel data, so that failures can be reproduced.
+struct SplitMix64 {
+    var state: UInt64
+    
+    mutating func next() -> UInt64 {
+        state &+= 0x9E37_79B9_7F4A_7C15
+        var z = state
+        z = (z ^ (z >> 30)) &* 0xBF58_476D_1CE4_E5B9
+        z = (z ^ (z >> 27)) &* 0x94D0_49BB_1331_11EB
+        return z ^ (z >> 31)
+    }
+}
+
+
+/// Pixels in `0...1`, so that half and float images don't contain NaNs or infinities.
+private func makePixels(width: Int, height: Int, numComponents: Int, componentSize: Int) -> [UInt8] {
+    var random = SplitMix64(state: UInt64(width * 31 + height * 17 + numComponents * 7 + componentSize))
+    let numValues = width * height * numComponents
+    var bytes = [UInt8](repeating: 0, count: numValues * componentSize)
+    bytes.withUnsafeMutableBytes { buffer in
+        for i in 0 ..< numValues {
+            let value = random.next()
+            switch componentSize {
+            case 1:
+                buffer.storeBytes(of: UInt8(truncatingIfNeeded: value), toByteOffset: i, as: UInt8.self)
+            case 2:
+                // Half floats up to 1.0 (0x3C00)
+                buffer.storeBytes(of: UInt16(value % 0x3C01), toByteOffset: i * 2, as: UInt16.self)
+            default:
+                buffer.storeBytes(of: Float(value % 1_000_001) / 1_000_000, toByteOffset: i * 4, as: Float.self)
+            }
+        }
+    }
+    return bytes
+}
+
+
+/// Converts a fresh copy of the pixels from sRGB to Rec. 2020 on up to `numThreads` threads.
+private func convert(_ pixels: [UInt8], width: Int, height: Int, numComponents: Int, componentSize: Int, numThreads: Int) throws -> [UInt8] {
+    let image = try #require(pixels.withUnsafeBufferPointer { buffer in
+        buffer.withMemoryRebound(to: CChar.self) { buffer in
+            LCMSImage.create(buffer.baseAddress!, width, height, numComponents, componentSize, false, nil, nil)
+        }
+    })
+    
+    let target = LCMSColorProfile.createRec2020(nil)
+    #expect(image.convertColorProfile(target, numThreads))
+    
+    return [UInt8](UnsafeRawBufferPointer(start: image.data, count: image.dataSize))
+}
+
+
+/// Images below and above the 64K-pixel slice threshold, including sizes that don't split evenly.
+private let imageSizes: [(width: Int, height: Int)] = [
+    (1, 1),
+    (64, 64),
+    (255, 257),
+    (256, 256),
+    (257, 255),
+    (300, 300),
+    (1023, 769),
+    (4096, 17)
+]
+
+
+/// `(numComponents, componentSize)` of the RGB and RGBA layouts. Gray images would need a gray source and target, there are no built-in gray profiles.
+private let pixelFormats: [(numComponents: Int, componentSize: Int)] = [3, 4].flatMap { numComponents in
+    [1, 2, 4].map { componentSize in (numComponents, componentSize) }
+}
+
+
+@Suite("Parallel conversion")
+struct ParallelConversionTests {
+    @Test("Parallel output is bit-identical to serial output", arguments: 0 ..< imageSizes.count)
+    func parallelMatchesSerial(sizeIndex: Int) throws {
+        let (width, height) = imageSizes[sizeIndex]
+        let numThreads = max(2, ProcessInfo.processInfo.activeProcessorCount)
+        
+        for (numComponents, componentSize) in pixelFormats {
+            let pixels = makePixels(width: width, height: height, numComponents: numComponents, componentSize: componentSize)
+            let serial = try convert(pixels, width: width, height: height, numComponents: numComponents, componentSize: componentSize, numThreads: 1)
+            let parallel = try convert(pixels, width: width, height: height, numComponents: numComponents, componentSize: componentSize, numThreads: numThreads)
+            
+            // Otherwise two untouched copies of the input would pass as identical
+            #expect(serial != pixels, "\(width)x\(height), \(numComponents) components of \(componentSize) bytes weren't converted")
+            
+            let isIdentical = serial.withUnsafeBytes { serial in
+                parallel.withUnsafeBytes { parallel in
+                    serial.count == parallel.count && memcmp(serial.baseAddress!, parallel.baseAddress!, serial.count) == 0
+                }
+            }
+            #expect(isIdentical, "\(width)x\(height), \(numComponents) components of \(componentSize) bytes")
+        }
+    }
+}